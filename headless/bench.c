@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+#define MAX_CATEGORIES 32
+
+typedef struct {
+  char name[32];
+  double *samples; /* microseconds */
+  int count;
+  int capacity;
+  long draws;
+  long updates;
+  long long update_area;
+} category_t;
+
+int bench_enabled = 0;
+
+static category_t g_categories[MAX_CATEGORIES];
+static int g_category_count = 0;
+
+static category_t *g_current = NULL;
+static struct timespec g_start;
+static long g_draws;
+static long g_updates;
+static long long g_update_area;
+
+void bench_init(void)
+{
+  bench_enabled = getenv("PB_BENCH") != NULL;
+}
+
+static category_t *find_category(const char *name)
+{
+  int i;
+
+  for (i = 0; i < g_category_count; ++i)
+    if (!strcmp(g_categories[i].name, name))
+      return &g_categories[i];
+
+  if (g_category_count == MAX_CATEGORIES)
+    return NULL;
+
+  snprintf(g_categories[g_category_count].name, sizeof(g_categories[0].name), "%s", name);
+  return &g_categories[g_category_count++];
+}
+
+static double g_last_us;
+static long g_last_draws;
+
+void bench_begin(const char *category)
+{
+  g_current = bench_enabled ? find_category(category) : NULL;
+  g_draws = 0;
+  g_updates = 0;
+  g_update_area = 0;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &g_start);
+}
+
+void bench_end(void)
+{
+  struct timespec end;
+  category_t *c = g_current;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+  g_last_us = (end.tv_sec - g_start.tv_sec) * 1e6 + (end.tv_nsec - g_start.tv_nsec) / 1e3;
+  g_last_draws = g_draws;
+
+  if (c == NULL)
+    return;
+
+  if (c->count == c->capacity)
+    {
+      c->capacity = c->capacity ? 2 * c->capacity : 64;
+      c->samples = realloc(c->samples, c->capacity * sizeof(double));
+    }
+  c->samples[c->count++] = g_last_us;
+  c->draws += g_draws;
+  c->updates += g_updates;
+  c->update_area += g_update_area;
+
+  g_current = NULL;
+}
+
+void bench_last(long *draws, double *us)
+{
+  *draws = g_last_draws;
+  *us = g_last_us;
+}
+
+void bench_count_draw(void)
+{
+  ++g_draws;
+}
+
+void bench_count_update(int w, int h)
+{
+  ++g_updates;
+  g_update_area += (long long)w * h;
+}
+
+static int cmp_double(const void *p1, const void *p2)
+{
+  const double d1 = *(const double*)p1;
+  const double d2 = *(const double*)p2;
+  return d1 < d2 ? -1 : d1 > d2;
+}
+
+static double percentile(const category_t *c, int p)
+{
+  return c->samples[(c->count - 1) * p / 100];
+}
+
+/* draws, updates and area are averages per event */
+void bench_report(void)
+{
+  int i;
+
+  if (!bench_enabled)
+    return;
+
+  printf("%-16s %6s %9s %9s %9s %9s %8s %8s %10s\n",
+	 "event", "count", "p50 us", "p90 us", "p99 us", "max us", "draws", "updates", "area px");
+  for (i = 0; i < g_category_count; ++i)
+    {
+      category_t *c = &g_categories[i];
+      if (c->count == 0)
+	continue;
+
+      qsort(c->samples, c->count, sizeof(double), cmp_double);
+      printf("%-16s %6d %9.1f %9.1f %9.1f %9.1f %8ld %8.1f %10lld\n",
+	     c->name, c->count,
+	     percentile(c, 50), percentile(c, 90), percentile(c, 99), c->samples[c->count - 1],
+	     c->draws / c->count,
+	     (double)c->updates / c->count,
+	     c->update_area / c->count);
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/*
+  Per-event cost accounting for the headless build.  Enabled by setting
+  PB_BENCH; the report goes to standard output when playback ends.
+*/
+
+extern int bench_enabled;
+
+void bench_init(void);
+
+void bench_begin(const char *category);
+void bench_end(void);
+
+/* draw calls and CPU time of the last event, measured even when disabled */
+void bench_last(long *draws, double *us);
+
+void bench_count_draw(void);
+void bench_count_update(int w, int h);
+
+void bench_report(void);
+
+#endif
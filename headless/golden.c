@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "golden.h"
+#include "bench.h"
+
+#define MAX_FRAMES 64
+
+typedef struct {
+  char name[64];
+  unsigned long long hash;
+} frame_t;
+
+static frame_t g_golden[MAX_FRAMES];
+static int g_golden_count = 0;
+
+static frame_t g_seen[MAX_FRAMES];
+static int g_seen_count = 0;
+
+static const char *g_path = NULL;
+static int g_update = 0;
+static int g_mismatches = 0;
+
+void golden_init(void)
+{
+  FILE *f;
+
+  g_path = getenv("PB_GOLDEN");
+  g_update = getenv("PB_GOLDEN_UPDATE") != NULL;
+  if (g_path == NULL || (f = fopen(g_path, "r")) == NULL)
+    return;
+
+  while (g_golden_count < MAX_FRAMES
+	 && fscanf(f, "%63s %llx", g_golden[g_golden_count].name, &g_golden[g_golden_count].hash) == 2)
+    ++g_golden_count;
+  fclose(f);
+}
+
+/* FNV-1a */
+static unsigned long long frame_hash(const unsigned char *fb, int size)
+{
+  unsigned long long h = 0xcbf29ce484222325ULL;
+  int i;
+  for (i = 0; i < size; ++i)
+    {
+      h ^= fb[i];
+      h *= 0x100000001b3ULL;
+    }
+  return h;
+}
+
+void golden_check(const char *name, const unsigned char *fb, int size)
+{
+  int i;
+  long draws;
+  double us;
+  const char *status = "new";
+  const unsigned long long hash = frame_hash(fb, size);
+
+  for (i = 0; i < g_golden_count; ++i)
+    if (!strcmp(g_golden[i].name, name))
+      {
+	if (g_golden[i].hash == hash)
+	  status = "ok";
+	else
+	  {
+	    status = "MISMATCH";
+	    ++g_mismatches;
+	  }
+	break;
+      }
+
+  /* a frame without a golden hash is only expected while updating */
+  if (i == g_golden_count && g_path != NULL && !g_update)
+    {
+      status = "MISSING";
+      ++g_mismatches;
+    }
+
+  if (g_seen_count < MAX_FRAMES)
+    {
+      snprintf(g_seen[g_seen_count].name, sizeof(g_seen[0].name), "%s", name);
+      g_seen[g_seen_count].hash = hash;
+      ++g_seen_count;
+    }
+
+  bench_last(&draws, &us);
+  printf("%-24s %016llx %6ld draws %9.1f us  %s\n", name, hash, draws, us, status);
+}
+
+int golden_finish(void)
+{
+  int i;
+  FILE *f;
+
+  if (!g_update || g_path == NULL)
+    return g_mismatches;
+
+  f = fopen(g_path, "w");
+  if (!f)
+    {
+      perror(g_path);
+      return g_mismatches;
+    }
+  for (i = 0; i < g_seen_count; ++i)
+    fprintf(f, "%s %016llx\n", g_seen[i].name, g_seen[i].hash);
+  fclose(f);
+  return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef GOLDEN_H
+#define GOLDEN_H
+
+/*
+  Golden frame hashes for the headless build.  PB_GOLDEN names a file of
+  "NAME HASH" lines that 'check NAME' events are compared against; with
+  PB_GOLDEN_UPDATE set the file is rewritten from the current frames.
+  Without it a frame that has no golden hash fails like a mismatch.
+*/
+
+void golden_init(void);
+void golden_check(const char *name, const unsigned char *fb, int size);
+
+/* number of mismatching or missing frames */
+int golden_finish(void);
+
+#endif
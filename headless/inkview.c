@@ -0,0 +1,620 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inkview.h"
+#include "bench.h"
+#include "golden.h"
+
+/*
+  Events are read one per line from the file named by PB_EVENTS, or
+  from standard input:
+
+    key NAME          EVT_KEYPRESS (left, right, up, down, ok, menu, prev, next, back)
+    repeat NAME [N]   EVT_KEYREPEAT
+    tap X Y           EVT_POINTERDOWN and EVT_POINTERUP
+    seed N            srand(N)
+    idle              fire pending timers
+    dump FILE         write the framebuffer as a PGM image
+    check NAME        compare the framebuffer hash with a golden one
+    exit              deliver EVT_EXIT and stop
+
+  With PB_BENCH set, the CPU time, draw calls and screen updates caused
+  by each event are reported per event kind when playback ends.
+
+  Empty lines and lines starting with '#' are ignored.
+*/
+
+#define PANEL_WIDTH 600
+#define PANEL_HEIGHT 800
+
+#define MAX_TIMERS 16
+
+static unsigned char g_fb[PANEL_WIDTH * PANEL_HEIGHT];
+static int g_orientation = ROTATE0;
+static icanvas g_screen = {
+  PANEL_WIDTH, PANEL_HEIGHT, PANEL_WIDTH, 8,
+  0, PANEL_WIDTH - 1, 0, PANEL_HEIGHT - 1,
+  g_fb
+};
+
+/* all drawing goes to the current canvas, see SetCanvas() */
+static icanvas *g_canvas = &g_screen;
+
+static iv_handler g_main_handler = NULL;
+static iv_handler g_handler = NULL;
+static int g_show_pending = 0;
+static int g_quit = 0;
+
+static ifont *g_font = NULL;
+static int g_font_color = BLACK;
+
+static struct {
+  const char *name;
+  iv_timerproc proc;
+  int ms;
+} g_timers[MAX_TIMERS];
+static int g_timer_count = 0;
+
+static inline int gray(int color)
+{
+  return color & 0xFF;
+}
+
+static inline unsigned char *pixel_addr(int x, int y)
+{
+  return g_canvas->addr + y * g_canvas->scanline + x;
+}
+
+static inline void put_pixel(int x, int y, int color)
+{
+  if (x >= g_canvas->clipx1 && x <= g_canvas->clipx2 && y >= g_canvas->clipy1 && y <= g_canvas->clipy2)
+    *pixel_addr(x, y) = gray(color);
+}
+
+/* clips a rectangle to the canvas clip, returns 0 if nothing is left */
+static int clip(int *x, int *y, int *w, int *h)
+{
+  if (*x < g_canvas->clipx1)
+    {
+      *w -= g_canvas->clipx1 - *x;
+      *x = g_canvas->clipx1;
+    }
+  if (*y < g_canvas->clipy1)
+    {
+      *h -= g_canvas->clipy1 - *y;
+      *y = g_canvas->clipy1;
+    }
+  if (*x + *w > g_canvas->clipx2 + 1)
+    *w = g_canvas->clipx2 + 1 - *x;
+  if (*y + *h > g_canvas->clipy2 + 1)
+    *h = g_canvas->clipy2 + 1 - *y;
+  return *w > 0 && *h > 0;
+}
+
+int ScreenWidth(void)
+{
+  return g_screen.width;
+}
+
+int ScreenHeight(void)
+{
+  return g_screen.height;
+}
+
+void SetOrientation(int n)
+{
+  g_orientation = n;
+  if (n == ROTATE90 || n == ROTATE270)
+    {
+      g_screen.width = PANEL_HEIGHT;
+      g_screen.height = PANEL_WIDTH;
+    }
+  else
+    {
+      g_screen.width = PANEL_WIDTH;
+      g_screen.height = PANEL_HEIGHT;
+    }
+  g_screen.scanline = g_screen.width;
+  g_screen.clipx1 = 0;
+  g_screen.clipx2 = g_screen.width - 1;
+  g_screen.clipy1 = 0;
+  g_screen.clipy2 = g_screen.height - 1;
+}
+
+int GetOrientation(void)
+{
+  return g_orientation;
+}
+
+icanvas *GetCanvas(void)
+{
+  return g_canvas;
+}
+
+void SetCanvas(icanvas *c)
+{
+  g_canvas = c != NULL ? c : &g_screen;
+}
+
+void SetClip(int x, int y, int w, int h)
+{
+  if (x < 0)
+    {
+      w += x;
+      x = 0;
+    }
+  if (y < 0)
+    {
+      h += y;
+      y = 0;
+    }
+  if (x + w > g_canvas->width)
+    w = g_canvas->width - x;
+  if (y + h > g_canvas->height)
+    h = g_canvas->height - y;
+  g_canvas->clipx1 = x;
+  g_canvas->clipy1 = y;
+  g_canvas->clipx2 = x + w - 1;
+  g_canvas->clipy2 = y + h - 1;
+}
+
+void ClearScreen(void)
+{
+  int i;
+
+  bench_count_draw();
+  for (i = 0; i < g_canvas->height; ++i)
+    memset(pixel_addr(0, i), 0xFF, g_canvas->width);
+}
+
+static void fill_area(int x, int y, int w, int h, int color)
+{
+  int i;
+
+  if (!clip(&x, &y, &w, &h))
+    return;
+  for (i = 0; i < h; ++i)
+    memset(pixel_addr(x, y + i), gray(color), w);
+}
+
+void FillArea(int x, int y, int w, int h, int color)
+{
+  bench_count_draw();
+  fill_area(x, y, w, h, color);
+}
+
+void InvertArea(int x, int y, int w, int h)
+{
+  int i, j;
+
+  bench_count_draw();
+
+  if (!clip(&x, &y, &w, &h))
+    return;
+  for (i = 0; i < h; ++i)
+    for (j = 0; j < w; ++j)
+      *pixel_addr(x + j, y + i) ^= 0xFF;
+}
+
+void DrawLine(int x1, int y1, int x2, int y2, int color)
+{
+  const int dx = abs(x2 - x1);
+  const int dy = -abs(y2 - y1);
+  const int sx = x1 < x2 ? 1 : -1;
+  const int sy = y1 < y2 ? 1 : -1;
+  int err = dx + dy;
+
+  bench_count_draw();
+
+  while (1)
+    {
+      put_pixel(x1, y1, color);
+      if (x1 == x2 && y1 == y2)
+	break;
+      if (2 * err >= dy)
+	{
+	  err += dy;
+	  x1 += sx;
+	}
+      if (2 * err <= dx)
+	{
+	  err += dx;
+	  y1 += sy;
+	}
+    }
+}
+
+static void draw_rect(int x, int y, int w, int h, int color)
+{
+  if (w <= 0 || h <= 0)
+    return;
+  fill_area(x, y, w, 1, color);
+  fill_area(x, y + h - 1, w, 1, color);
+  fill_area(x, y, 1, h, color);
+  fill_area(x + w - 1, y, 1, h, color);
+}
+
+void DrawRect(int x, int y, int w, int h, int color)
+{
+  bench_count_draw();
+  draw_rect(x, y, w, h, color);
+}
+
+void DrawSelection(int x, int y, int w, int h, int color)
+{
+  bench_count_draw();
+  draw_rect(x, y, w, h, color);
+  draw_rect(x + 1, y + 1, w - 2, h - 2, color);
+}
+
+static int bitmap_pixel(const ibitmap *src, int x, int y)
+{
+  const unsigned char *row = src->data + y * src->scanline;
+
+  switch (src->depth)
+    {
+    case 8:
+      return row[x];
+    case 4:
+      return ((row[x / 2] >> (4 * (1 - x % 2))) & 0x0F) * 0x11;
+    case 2:
+      return ((row[x / 4] >> (2 * (3 - x % 4))) & 0x03) * 0x55;
+    case 1:
+      return (row[x / 8] >> (7 - x % 8)) & 1 ? 0xFF : 0x00;
+    default:
+      return 0xFF;
+    }
+}
+
+void StretchBitmap(int x, int y, int w, int h, const ibitmap *src, int flags)
+{
+  int i, j;
+
+  bench_count_draw();
+  if (src == NULL || w <= 0 || h <= 0)
+    return;
+
+  for (i = 0; i < h; ++i)
+    {
+      const int sy = i * src->height / h;
+      if (y + i < g_canvas->clipy1 || y + i > g_canvas->clipy2)
+	continue;
+      for (j = 0; j < w; ++j)
+	{
+	  const int sx = j * src->width / w;
+	  put_pixel(x + j, y + i, bitmap_pixel(src, sx, sy));
+	}
+    }
+}
+
+void DrawBitmap(int x, int y, const ibitmap *b)
+{
+  int cx = x, cy = y, w = b->width, h = b->height;
+  int i, j;
+
+  bench_count_draw();
+  if (!clip(&cx, &cy, &w, &h))
+    return;
+
+  for (i = 0; i < h; ++i)
+    if (b->depth == 8)
+      memcpy(pixel_addr(cx, cy + i), b->data + (cy - y + i) * b->scanline + (cx - x), w);
+    else
+      for (j = 0; j < w; ++j)
+	*pixel_addr(cx + j, cy + i) = bitmap_pixel(b, cx - x + j, cy - y + i);
+}
+
+ifont *OpenFont(const char *name, int size, int aa)
+{
+  ifont *f = malloc(sizeof(ifont));
+  f->name = strdup(name);
+  f->size = size;
+  f->aa = aa;
+  return f;
+}
+
+void CloseFont(ifont *f)
+{
+  if (f == NULL)
+    return;
+  if (g_font == f)
+    g_font = NULL;
+  free(f->name);
+  free(f);
+}
+
+void SetFont(ifont *font, int color)
+{
+  g_font = font;
+  g_font_color = color;
+}
+
+/* glyphs are boxes of half the font size; count UTF-8 code points */
+static int glyph_count(const char *s)
+{
+  int n = 0;
+  for (; *s; ++s)
+    if ((*s & 0xC0) != 0x80)
+      ++n;
+  return n;
+}
+
+static int glyph_width(void)
+{
+  return g_font ? g_font->size / 2 : 8;
+}
+
+int StringWidth(const char *s)
+{
+  return glyph_count(s) * glyph_width();
+}
+
+char *DrawTextRect(int x, int y, int w, int h, const char *s, int flags)
+{
+  const int gw = glyph_width();
+  const int gh = g_font ? g_font->size * 2 / 3 : 10;
+  int width = StringWidth(s);
+  int gx, gy;
+
+  bench_count_draw();
+
+  if (width > w && (flags & ALIGN_FIT))
+    width = w;
+
+  if (flags & ALIGN_CENTER)
+    gx = x + (w - width) / 2;
+  else if (flags & ALIGN_RIGHT)
+    gx = x + w - width;
+  else
+    gx = x;
+
+  if (flags & VALIGN_MIDDLE)
+    gy = y + (h - gh) / 2;
+  else if (flags & VALIGN_BOTTOM)
+    gy = y + h - gh;
+  else
+    gy = y;
+
+  for (; *s && gx + gw <= x + w; ++s)
+    {
+      if ((*s & 0xC0) == 0x80)
+	continue;
+      if (*s != ' ')
+	draw_rect(gx + 1, gy, gw - 2, gh, g_font_color);
+      gx += gw;
+    }
+  return NULL;
+}
+
+void FullUpdate(void)
+{
+  bench_count_update(g_screen.width, g_screen.height);
+}
+
+void PartialUpdate(int x, int y, int w, int h)
+{
+  bench_count_update(w, h);
+}
+
+static void set_timer(const char *name, iv_timerproc tproc, int ms)
+{
+  int i;
+
+  for (i = 0; i < g_timer_count; ++i)
+    if (!strcmp(g_timers[i].name, name) || g_timers[i].proc == tproc)
+      break;
+  if (i == MAX_TIMERS)
+    return;
+  if (i == g_timer_count)
+    ++g_timer_count;
+
+  g_timers[i].name = name;
+  g_timers[i].proc = tproc;
+  g_timers[i].ms = ms;
+}
+
+void SetHardTimer(const char *name, iv_timerproc tproc, int ms)
+{
+  set_timer(name, tproc, ms);
+}
+
+void SetWeakTimer(const char *name, iv_timerproc tproc, int ms)
+{
+  set_timer(name, tproc, ms);
+}
+
+void ClearTimer(iv_timerproc tproc)
+{
+  int i;
+
+  for (i = 0; i < g_timer_count; ++i)
+    if (g_timers[i].proc == tproc)
+      {
+	g_timers[i] = g_timers[--g_timer_count];
+	return;
+      }
+}
+
+static void deliver_show(void)
+{
+  while (g_show_pending && !g_quit)
+    {
+      g_show_pending = 0;
+      g_handler(EVT_SHOW, 0, 0);
+    }
+}
+
+/* fires pending timers, shortest delay first */
+static void fire_timers(void)
+{
+  while (g_timer_count > 0)
+    {
+      int i;
+      int first = 0;
+      iv_timerproc proc;
+
+      for (i = 1; i < g_timer_count; ++i)
+	if (g_timers[i].ms < g_timers[first].ms)
+	  first = i;
+
+      proc = g_timers[first].proc;
+      g_timers[first] = g_timers[--g_timer_count];
+
+      bench_begin("timer");
+      proc();
+      deliver_show();
+      bench_end();
+    }
+}
+
+static void send_event(const char *category, int type, int par1, int par2)
+{
+  bench_begin(category);
+  if (g_handler != NULL)
+    g_handler(type, par1, par2);
+  deliver_show();
+  bench_end();
+}
+
+iv_handler SetEventHandler(iv_handler h)
+{
+  iv_handler old = g_handler;
+  g_handler = h;
+  g_show_pending = 1;
+  return old;
+}
+
+iv_handler GetEventHandler(void)
+{
+  return g_handler;
+}
+
+void CloseApp(void)
+{
+  g_quit = 1;
+}
+
+static void dump(const char *path)
+{
+  FILE *f = fopen(path, "wb");
+  if (!f)
+    return;
+  fprintf(f, "P5\n%d %d\n255\n", g_screen.width, g_screen.height);
+  fwrite(g_fb, 1, g_screen.width * g_screen.height, f);
+  fclose(f);
+}
+
+static const struct {
+  const char *name;
+  int code;
+} g_keys[] = {
+  { "left", KEY_LEFT },
+  { "right", KEY_RIGHT },
+  { "up", KEY_UP },
+  { "down", KEY_DOWN },
+  { "ok", KEY_OK },
+  { "menu", KEY_MENU },
+  { "prev", KEY_PREV },
+  { "next", KEY_NEXT },
+  { "back", KEY_BACK },
+  { NULL, 0 }
+};
+
+static int key_code(const char *name)
+{
+  int i;
+  for (i = 0; g_keys[i].name != NULL; ++i)
+    if (!strcmp(g_keys[i].name, name))
+      return g_keys[i].code;
+  return 0;
+}
+
+static void play(FILE *script)
+{
+  char line[256];
+
+  while (!g_quit && fgets(line, sizeof(line), script))
+    {
+      char cmd[32];
+      char arg[200];
+      char category[240];
+      int a, b;
+
+      if (sscanf(line, "%31s", cmd) != 1 || cmd[0] == '#')
+	continue;
+
+      if (!strcmp(cmd, "key") && sscanf(line, "%*s %199s", arg) == 1)
+	{
+	  snprintf(category, sizeof(category), "key %s", arg);
+	  send_event(category, EVT_KEYPRESS, key_code(arg), 0);
+	}
+      else if (!strcmp(cmd, "repeat") && sscanf(line, "%*s %199s", arg) == 1)
+	{
+	  int n = 1;
+	  sscanf(line, "%*s %*s %d", &n);
+	  snprintf(category, sizeof(category), "repeat %s", arg);
+	  while (n-- > 0 && !g_quit)
+	    send_event(category, EVT_KEYREPEAT, key_code(arg), 1);
+	}
+      else if (!strcmp(cmd, "tap") && sscanf(line, "%*s %d %d", &a, &b) == 2)
+	{
+	  send_event("tap", EVT_POINTERDOWN, a, b);
+	  send_event("tap up", EVT_POINTERUP, a, b);
+	}
+      else if (!strcmp(cmd, "seed") && sscanf(line, "%*s %d", &a) == 1)
+	srand(a);
+      else if (!strcmp(cmd, "idle"))
+	{
+	  fire_timers();
+	  deliver_show();
+	}
+      else if (!strcmp(cmd, "dump") && sscanf(line, "%*s %199s", arg) == 1)
+	dump(arg);
+      else if (!strcmp(cmd, "check") && sscanf(line, "%*s %199s", arg) == 1)
+	golden_check(arg, g_fb, g_screen.width * g_screen.height);
+      else if (!strcmp(cmd, "exit"))
+	break;
+      else
+	fprintf(stderr, "headless: unknown event: %s", line);
+    }
+}
+
+void InkViewMain(iv_handler h)
+{
+  const char *path = getenv("PB_EVENTS");
+  FILE *script = stdin;
+
+  if (path != NULL && (script = fopen(path, "r")) == NULL)
+    {
+      perror(path);
+      exit(1);
+    }
+
+  bench_init();
+  golden_init();
+  ClearScreen();
+
+  g_main_handler = h;
+  g_handler = h;
+  bench_begin("init");
+  h(EVT_INIT, 0, 0);
+  deliver_show();
+  bench_end();
+
+  play(script);
+  if (!g_quit)
+    fire_timers();
+
+  bench_begin("exit");
+  g_main_handler(EVT_EXIT, 0, 0);
+  bench_end();
+
+  bench_report();
+
+  if (script != stdin)
+    fclose(script);
+
+  if (golden_finish() != 0)
+    exit(1);
+}
@@ -0,0 +1,125 @@
+#ifndef INKVIEW_H
+#define INKVIEW_H
+
+/*
+  Headless stand-in for the parts of the PocketBook inkview API used by
+  the game.  Drawing goes to an in-memory 8-bit grayscale framebuffer and
+  events are played back from a script (see inkview.c).
+*/
+
+#include <time.h>
+#include <limits.h>
+
+#define STATEPATH "."
+
+#define DEFAULTFONT "LiberationSans"
+#define DEFAULTFONTB "LiberationSans-Bold"
+
+#define EVT_INIT 21
+#define EVT_EXIT 22
+#define EVT_SHOW 23
+#define EVT_REPAINT 23
+#define EVT_HIDE 24
+#define EVT_KEYPRESS 25
+#define EVT_KEYRELEASE 26
+#define EVT_KEYREPEAT 28
+#define EVT_POINTERUP 29
+#define EVT_POINTERDOWN 30
+#define EVT_POINTERMOVE 31
+
+#define KEY_BACK 0x1b
+#define KEY_DELETE 0x08
+#define KEY_OK 0x0a
+#define KEY_UP 0x11
+#define KEY_DOWN 0x12
+#define KEY_LEFT 0x13
+#define KEY_RIGHT 0x14
+#define KEY_MINUS 0x15
+#define KEY_PLUS 0x16
+#define KEY_MENU 0x17
+#define KEY_PREV 0x18
+#define KEY_NEXT 0x19
+
+#define BLACK 0x000000
+#define DGRAY 0x555555
+#define LGRAY 0xaaaaaa
+#define WHITE 0xffffff
+
+#define ROTATE0 0
+#define ROTATE90 1
+#define ROTATE270 2
+#define ROTATE180 3
+
+#define ALIGN_LEFT 1
+#define ALIGN_CENTER 2
+#define ALIGN_RIGHT 4
+#define ALIGN_FIT 8
+#define VALIGN_TOP 16
+#define VALIGN_MIDDLE 32
+#define VALIGN_BOTTOM 64
+
+typedef struct ibitmap_s {
+  unsigned short width;
+  unsigned short height;
+  unsigned short depth;
+  unsigned short scanline;
+  unsigned char data[];
+} ibitmap;
+
+typedef struct ifont_s {
+  char *name;
+  int size;
+  int aa;
+} ifont;
+
+typedef struct icanvas_s {
+  int width;
+  int height;
+  int scanline;
+  int depth;
+  int clipx1, clipx2;
+  int clipy1, clipy2;
+  unsigned char *addr;
+} icanvas;
+
+typedef int (*iv_handler)(int type, int par1, int par2);
+typedef void (*iv_menuhandler)(int index);
+typedef void (*iv_timerproc)(void);
+
+void InkViewMain(iv_handler h);
+void CloseApp(void);
+iv_handler SetEventHandler(iv_handler h);
+iv_handler GetEventHandler(void);
+
+int ScreenWidth(void);
+int ScreenHeight(void);
+void SetOrientation(int n);
+int GetOrientation(void);
+
+icanvas *GetCanvas(void);
+void SetCanvas(icanvas *c);
+void SetClip(int x, int y, int w, int h);
+
+void ClearScreen(void);
+void FillArea(int x, int y, int w, int h, int color);
+void InvertArea(int x, int y, int w, int h);
+void DrawRect(int x, int y, int w, int h, int color);
+void DrawLine(int x1, int y1, int x2, int y2, int color);
+void DrawSelection(int x, int y, int w, int h, int color);
+void DrawBitmap(int x, int y, const ibitmap *b);
+void StretchBitmap(int x, int y, int w, int h, const ibitmap *src, int flags);
+
+ifont *OpenFont(const char *name, int size, int aa);
+void CloseFont(ifont *f);
+void SetFont(ifont *font, int color);
+int StringWidth(const char *s);
+char *DrawTextRect(int x, int y, int w, int h, const char *s, int flags);
+
+void FullUpdate(void);
+void PartialUpdate(int x, int y, int w, int h);
+
+void SetHardTimer(const char *name, iv_timerproc tproc, int ms);
+void SetWeakTimer(const char *name, iv_timerproc tproc, int ms);
+void ClearTimer(iv_timerproc tproc);
+
+#endif
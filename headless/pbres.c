@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+  Host replacement for the SDK's "pbres -c OUT.c FILES..." covering what
+  the game needs: uncompressed 8-bit palette and 24-bit BMP files become
+  8-bit grayscale ibitmap definitions named after the file.
+*/
+
+static unsigned int le16(const unsigned char *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+static unsigned int le32(const unsigned char *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static int luma(int r, int g, int b)
+{
+  return (r * 299 + g * 587 + b * 114) / 1000;
+}
+
+static unsigned char *read_file(const char *path, long *size)
+{
+  unsigned char *buf;
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return NULL;
+
+  fseek(f, 0, SEEK_END);
+  *size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  buf = malloc(*size);
+  if (fread(buf, 1, *size, f) != (size_t)*size)
+    {
+      free(buf);
+      buf = NULL;
+    }
+  fclose(f);
+  return buf;
+}
+
+static void symbol_name(const char *path, char *name, size_t size)
+{
+  const char *base = strrchr(path, '/');
+  char *dot;
+
+  base = base ? base + 1 : path;
+  snprintf(name, size, "%s", base);
+  dot = strrchr(name, '.');
+  if (dot)
+    *dot = '\0';
+}
+
+static int convert(FILE *out, const char *path)
+{
+  long size;
+  unsigned char *bmp = read_file(path, &size);
+  unsigned int offset, width, bpp, stride, x;
+  int height, y;
+  char name[256];
+
+  if (bmp == NULL || size < 54 || bmp[0] != 'B' || bmp[1] != 'M')
+    {
+      fprintf(stderr, "pbres: %s: not a BMP file\n", path);
+      free(bmp);
+      return 0;
+    }
+
+  offset = le32(bmp + 10);
+  width = le32(bmp + 18);
+  height = (int)le32(bmp + 22);
+  bpp = le16(bmp + 28);
+  if ((bpp != 8 && bpp != 24) || le32(bmp + 30) != 0)
+    {
+      fprintf(stderr, "pbres: %s: unsupported format\n", path);
+      free(bmp);
+      return 0;
+    }
+
+  stride = (width * bpp / 8 + 3) & ~3u;
+  symbol_name(path, name, sizeof(name));
+
+  fprintf(out, "const ibitmap %s = { %u, %d, 8, %u, {", name, width, height < 0 ? -height : height, width);
+  for (y = 0; y < (height < 0 ? -height : height); ++y)
+    {
+      /* rows are stored bottom-up unless the height is negative */
+      const unsigned char *row = bmp + offset + stride * (height < 0 ? y : height - 1 - y);
+      fprintf(out, "\n ");
+      for (x = 0; x < width; ++x)
+	{
+	  int v;
+	  if (bpp == 8)
+	    {
+	      const unsigned char *pal = bmp + 14 + le32(bmp + 14) + 4 * row[x];
+	      v = luma(pal[2], pal[1], pal[0]);
+	    }
+	  else
+	    v = luma(row[3 * x + 2], row[3 * x + 1], row[3 * x]);
+	  fprintf(out, " %d,", v);
+	}
+    }
+  fprintf(out, "\n} };\n\n");
+
+  free(bmp);
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  int i;
+  FILE *out;
+
+  if (argc < 3 || strcmp(argv[1], "-c"))
+    {
+      fprintf(stderr, "usage: pbres -c OUT.c FILE.bmp...\n");
+      return 1;
+    }
+
+  out = fopen(argv[2], "w");
+  if (!out)
+    {
+      perror(argv[2]);
+      return 1;
+    }
+
+  fprintf(out, "#include \"inkview.h\"\n\n");
+  for (i = 3; i < argc; ++i)
+    if (!convert(out, argv[i]))
+      {
+	fclose(out);
+	remove(argv[2]);
+	return 1;
+      }
+
+  fclose(out);
+  return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+
+/*
+  Tile faces packed at build time by tools/mkatlas: 4-bit gray, two
+  pixels per byte with the left one in the high nibble, every tile of a
+  level stored one under the other.  Level 0 has the original size, the
+  others are filtered down from it, largest first.  index maps a chip to
+  its tile plus one, or to 0 if there is no face for it.
+*/
+
+#define ATLAS_DEPTH (4)
+#define ATLAS_MAX_LEVELS (4)
+
+typedef struct {
+  unsigned short tile_width;
+  unsigned short tile_height;
+  unsigned short scanline;
+  const unsigned char *data;
+} atlas_level_t;
+
+typedef struct {
+  unsigned short count;
+  unsigned short level_count;
+  unsigned char index[256];
+  atlas_level_t levels[ATLAS_MAX_LEVELS];
+} atlas_t;
+
+extern const atlas_t tile_atlas;
+
+#endif
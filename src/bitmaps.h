@@ -1,9 +1,13 @@
 #ifndef BITMAPS_H
 #define BITMAPS_H
 
-void bitmaps_init(void);
+#include "inkview.h"
+#include "board.h"
 
-extern const ibitmap* bitmaps[256];
+/*
+  Draws the face of the chip stretched to the rect, from the smallest
+  atlas level still covering it.
+*/
+void draw_chip_face(chip_t chip, int x, int y, int w, int h);
 
 #endif
-
@@ -1,47 +1,34 @@
 #include <string.h>
 #include "board.h"
 #include "common.h"
+#include "trace.h"
 
-int position_equal(const position_t *pos1, const position_t *pos2)
+int chips_fit(chip_t a, chip_t b)
 {
-  return pos1->x == pos2->x
-    && pos1->y == pos2->y
-    && pos1->k == pos2->k;
+  int category = a & 0xC0;
+  if (category == 0xC0) /*flowers*/
+    {
+      return (a & 0xF0) == (b & 0xF0);
+    }
+  else
+    {
+      return a == b;
+    }
 }
 
-chip_t board_get(const board_t *board, const position_t *pos)
+/* columns and levels always fit their bits, rows may not */
+chip_t board_get(const board_t *board, position_t pos)
 {
-  if (pos->y < 0 || pos->y >= MAX_ROW_COUNT)
+  if (position_y(pos) >= MAX_ROW_COUNT)
     return 0;
-  if (pos->x < 0 || pos->x >= MAX_COL_COUNT)
-    return 0;
-  if (pos->k < 0 || pos->k >= MAX_HEIGHT)
-    return 0;
-
-  return board->columns[pos->y][pos->x].chips[pos->k];
-}
 
-void board_set(board_t *board, const position_t *pos, chip_t chip)
-{
-  if (pos->y < 0 || pos->y >= MAX_ROW_COUNT)
-    return;
-  if (pos->x < 0 || pos->x >= MAX_COL_COUNT)
-    return;
-  if (pos->k < 0 || pos->k >= MAX_HEIGHT)
-    return;
-
-  board->columns[pos->y][pos->x].chips[pos->k] = chip;
+  return board->columns[position_y(pos)][position_x(pos)].chips[position_k(pos)];
 }
 
-static int column_height(board_t *board, int y, int x)
+static int column_height(const board_t *board, int y, int x)
 {
   int k;
 
-  if (y < 0 || y >= MAX_ROW_COUNT)
-    return 0;
-  if (x < 0 || x >= MAX_COL_COUNT)
-    return 0;
-
   for (k = MAX_HEIGHT-1; k >= 0; --k)
     {
       chip_t chip = board->columns[y][x].chips[k];
@@ -63,10 +50,10 @@ static chip_t safe_get(const board_t *board, int y, int x, int k)
   return board->columns[y][x].chips[k];
 }
 
-static int selectable(board_t *board, int y, int x)
+static int selectable(const board_t *board, int y, int x)
 {
   int i, j;
-  int h = column_height(board, y, x);
+  int h = board->heights[y][x];
   int l, r;
 
   if (h == 0)
@@ -91,75 +78,209 @@ static int selectable(board_t *board, int y, int x)
   return h;
 }
 
-positions_t* get_selectable_positions(board_t *board)
+/* recompute selectability of every column a change at (y, x) can affect */
+static void update_neighbourhood(board_t *board, int y, int x, move_t *move)
 {
   int i, j;
 
-  positions_t* positions = malloc(sizeof(positions_t));
-  positions->count = 0;
-  
-  for (i = 0; i < MAX_ROW_COUNT; ++i)
-    for (j = 0; j < MAX_COL_COUNT; ++j)
+  for (i = max_int(y - 1, 0); i <= min_int(y + 1, MAX_ROW_COUNT - 1); ++i)
+    for (j = max_int(x - 2, 0); j <= min_int(x + 2, MAX_COL_COUNT - 1); ++j)
       {
-	int h = selectable(board, i, j);
-	if (h)
+	const int s = selectable(board, i, j);
+	const int old = board->selectable[i][j];
+
+	if (s == old)
+	  continue;
+
+	if (move)
 	  {
-	    positions->positions[positions->count].y = i;
-	    positions->positions[positions->count].x = j;
-	    positions->positions[positions->count].k = h - 1;
-	    ++positions->count;
+	    move->delta[move->delta_count].y = i;
+	    move->delta[move->delta_count].x = j;
+	    move->delta[move->delta_count].selectable = old;
+	    ++move->delta_count;
 	  }
+
+	if (old == 0)
+	  ++board->selectable_count;
+	else if (s == 0)
+	  --board->selectable_count;
+	board->selectable[i][j] = s;
       }
+}
 
-  return positions;
+/*
+  Zobrist key of a chip in a slot.  A table would need an entry for
+  every (slot, chip) pair, so keys are derived with a 64-bit mixer
+  (splitmix64 finalizer) instead.  Empty slots contribute nothing.
+*/
+static uint64_t zobrist_key(position_t pos, chip_t chip)
+{
+  uint64_t z;
+
+  if (chip == 0)
+    return 0;
+
+  /* the packed position is (y * MAX_COL_COUNT + x) * MAX_HEIGHT + k */
+  z = ((uint64_t)pos << 8) | chip;
+  z += 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
 }
 
-static int colorize(board_t *board, chip_t *pairs, int pile_size, board_t *result_board)
+static void put_chip(board_t *board, position_t pos, chip_t chip, move_t *move)
 {
-  int i, j;
+  const int y = position_y(pos);
+  const int x = position_x(pos);
+  chip_t *cell = &board->columns[y][x].chips[position_k(pos)];
+
+  if (*cell == chip)
+    return;
 
-  positions_t *positions = get_selectable_positions(board);
+  if (*cell == 0)
+    ++board->chip_count;
+  else if (chip == 0)
+    --board->chip_count;
+  board->hash ^= zobrist_key(pos, *cell) ^ zobrist_key(pos, chip);
+  *cell = chip;
+
+  board->heights[y][x] = column_height(board, y, x);
+  update_neighbourhood(board, y, x, move);
+}
+
+void board_set(board_t *board, position_t pos, chip_t chip)
+{
+  if (position_y(pos) >= MAX_ROW_COUNT)
+    return;
+
+  put_chip(board, pos, chip, NULL);
+}
 
-  if (positions->count < 2)
+void board_clear(board_t *board)
+{
+  memset(board, 0, sizeof(board_t));
+}
+
+uint64_t board_hash(const board_t *board)
+{
+  return board->hash;
+}
+
+void board_remove_pair(board_t *board, position_t pos1, position_t pos2, move_t *move)
+{
+  move->positions[0] = pos1;
+  move->positions[1] = pos2;
+  move->chips[0] = board_get(board, pos1);
+  move->chips[1] = board_get(board, pos2);
+  move->chip_count = board->chip_count;
+  move->selectable_count = board->selectable_count;
+  move->hash = board->hash;
+  move->delta_count = 0;
+
+  put_chip(board, pos1, 0, move);
+  put_chip(board, pos2, 0, move);
+}
+
+void board_restore_pair(board_t *board, const move_t *move)
+{
+  int i;
+
+  for (i = 1; i >= 0; --i)
     {
-      free(positions);
-      return 0;
+      const int y = position_y(move->positions[i]);
+      const int x = position_x(move->positions[i]);
+      const int k = position_k(move->positions[i]);
+      board->columns[y][x].chips[k] = move->chips[i];
+      if (board->heights[y][x] < k + 1)
+	board->heights[y][x] = k + 1;
     }
 
-  shuffle(positions->positions, positions->count, sizeof(position_t));
+  for (i = move->delta_count - 1; i >= 0; --i)
+    board->selectable[move->delta[i].y][move->delta[i].x] = move->delta[i].selectable;
+
+  board->chip_count = move->chip_count;
+  board->selectable_count = move->selectable_count;
+  board->hash = move->hash;
+}
+
+void board_get_selectables(const board_t *board, positions_t *positions)
+{
+  int i, j;
+
+  positions->count = 0;
+  for (i = 0; i < MAX_ROW_COUNT; ++i)
+    for (j = 0; j < MAX_COL_COUNT; ++j)
+      {
+	int h = board->selectable[i][j];
+	if (h)
+	  positions->positions[positions->count++] = position_make(i, j, h - 1);
+      }
+}
+
+/* search nodes a single dealing attempt may visit before giving up */
+#define DEAL_BUDGET (5000)
+#define DEAL_ATTEMPTS (8)
+
+static int colorize(board_t *board, chip_t *pairs, int pile_size, board_t *result_board, int *budget)
+{
+  int i, j;
+  /* small enough to live on the stack of every level of the search */
+  positions_t positions;
+
+  if (--*budget < 0)
+    return 0;
+
+  board_get_selectables(board, &positions);
+
+  if (positions.count < 2)
+    return 0;
+
+  shuffle(positions.positions, positions.count, sizeof(position_t));
   
   if (pile_size == 2)
     {
-      board_set(result_board, &positions->positions[0], pairs[0]);
-      board_set(result_board, &positions->positions[1], pairs[1]);
-
-      free(positions);
+      board_set(result_board, positions.positions[0], pairs[0]);
+      board_set(result_board, positions.positions[1], pairs[1]);
       return 1;
     }
 
-  for (i = 0; i < positions->count - 1; ++i)
-    for (j = i + 1; j < positions->count; ++j)
+  for (i = 0; i < positions.count - 1 && *budget >= 0; ++i)
+    for (j = i + 1; j < positions.count && *budget >= 0; ++j)
       {
-	const position_t* p1 = &positions->positions[i];
-	const position_t* p2 = &positions->positions[j];
+	const position_t p1 = positions.positions[i];
+	const position_t p2 = positions.positions[j];
+	move_t move;
 
-	board_set(board, p1, 0);
-	board_set(board, p2, 0);
+	board_remove_pair(board, p1, p2, &move);
 
-	if (colorize(board, &pairs[2], pile_size - 2, result_board))
+	if (colorize(board, &pairs[2], pile_size - 2, result_board, budget))
 	  {
 	    board_set(result_board, p1, pairs[0]);
 	    board_set(result_board, p2, pairs[1]);
-	    
-	    free(positions);
 	    return 1;
 	  }
 
-	board_set(board, p1, 0xFF);
-	board_set(board, p2, 0xFF);
+	board_restore_pair(board, &move);
       }
   
-  free(positions);
+  return 0;
+}
+
+/* deals pairs of the pile over occupied slots of the shape so that the result is solvable */
+static int deal(board_t *shape, chip_t *pile, int pile_size, board_t *result_board)
+{
+  int attempt;
+
+  for (attempt = 0; attempt < DEAL_ATTEMPTS; ++attempt)
+    {
+      int budget = DEAL_BUDGET;
+
+      board_clear(result_board);
+      if (colorize(shape, pile, pile_size, result_board, &budget))
+	return 1;
+
+      shuffle(pile, pile_size / 2, 2 * sizeof(chip_t));
+    }
   return 0;
 }
 
@@ -203,17 +324,9 @@ static void get_pile(chip_t pile[144])
     pile[c++] = 0xE1 + j;
 }		
 
-static void clear_board(board_t *board)
-{
-  int i, j;
-
-  for (i = 0; i < MAX_ROW_COUNT; ++i)
-    for (j = 0; j < MAX_COL_COUNT; ++j)
-      memset(&board->columns[i][j].chips[0], 0, sizeof(chip_t) * MAX_HEIGHT);
-}
-
 void generate_board(board_t *board, map_t *map)
 {
+  TRACE_SCOPE("generate_board");
   int i;
   board_t tmp;
   chip_t pile[144];
@@ -224,17 +337,54 @@ void generate_board(board_t *board, map_t *map)
   shuffle(&pile[140], 4, sizeof(chip_t));
   shuffle(pile, 72, 2 * sizeof(chip_t));
 
-  clear_board(&tmp);
+  board_clear(&tmp);
   for (i = 0; i < 144; ++i)
     {
-      const int x = map->map[i].x;
-      const int y = map->map[i].y;
-      const int z = map->map[i].z;
-      
-      tmp.columns[y][x].chips[z] = 0xFF;
+      board_set(&tmp, position_make(map->map[i].y, map->map[i].x, map->map[i].z), 0xFF);
     }
   
-  clear_board(board);
-  colorize(&tmp, pile, 144, board);
+  /* every attempt reshuffles the pile; the maps always have a solvable deal */
+  while (!deal(&tmp, pile, 144, board))
+    ;
+}
+
+static int cmp_chip(const void *c1, const void *c2)
+{
+  return *(const chip_t*)c1 - *(const chip_t*)c2;
+}
+
+int board_reshuffle(board_t *board)
+{
+  int i, j, k;
+  int count = 0;
+  board_t shape;
+  board_t result;
+  chip_t pile[144];
+
+  board_clear(&shape);
+  for (i = 0; i < MAX_ROW_COUNT; ++i)
+    for (j = 0; j < MAX_COL_COUNT; ++j)
+      for (k = 0; k < board->heights[i][j]; ++k)
+	{
+	  const chip_t chip = board->columns[i][j].chips[k];
+	  if (chip && count < 144)
+	    {
+	      pile[count++] = chip;
+	      board_set(&shape, position_make(i, j, k), 0xFF);
+	    }
+	}
+
+  if (count < 2)
+    return 0;
+
+  /* fitting chips sort next to each other and every group has an even count left */
+  qsort(pile, count, sizeof(chip_t), cmp_chip);
+  shuffle(pile, count / 2, 2 * sizeof(chip_t));
+
+  if (!deal(&shape, pile, count, &result))
+    return 0;
+
+  *board = result;
+  return 1;
 }
 
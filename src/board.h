@@ -1,6 +1,8 @@
 #ifndef BOARD_H
 #define BOARD_H
 
+#include <stdint.h>
+
 /*
   category 2-bit
   suit - 2-bit
@@ -18,23 +20,79 @@ typedef struct {
 
 typedef struct {
   column_t columns[MAX_ROW_COUNT][MAX_COL_COUNT];
+
+  /* derived state, kept up to date by board_set() and friends */
+  unsigned char heights[MAX_ROW_COUNT][MAX_COL_COUNT];
+  unsigned char selectable[MAX_ROW_COUNT][MAX_COL_COUNT]; /* height of a free column or 0 */
+  int chip_count;
+  int selectable_count;
+  uint64_t hash;
 } board_t;
 
-typedef struct {
-  int y, x, k;
-} position_t;
+/*
+  A slot packed into 14 bits: row (5 bits), column (5 bits) and level
+  (4 bits).  Packed positions compare in board order, so equality and
+  sorting are plain integer operations.
+*/
+typedef uint16_t position_t;
 
-int position_equal(const position_t *pos1, const position_t *pos2);
+static inline position_t position_make(int y, int x, int k)
+{
+  return (position_t)((y << 9) | (x << 4) | k);
+}
+
+static inline int position_y(position_t pos)
+{
+  return pos >> 9;
+}
+
+static inline int position_x(position_t pos)
+{
+  return (pos >> 4) & 0x1F;
+}
+
+static inline int position_k(position_t pos)
+{
+  return pos & 0xF;
+}
 
 typedef struct {
   position_t positions[144];
   int count;
 } positions_t;
 
-positions_t* get_selectable_positions(board_t *board);
+void board_get_selectables(const board_t *board, positions_t *positions);
+
+int chips_fit(chip_t a, chip_t b);
 
-chip_t board_get(const board_t *board, const position_t *pos);
-void board_set(board_t *board, const position_t *pos, chip_t chip);
+chip_t board_get(const board_t *board, position_t pos);
+void board_set(board_t *board, position_t pos, chip_t chip);
+void board_clear(board_t *board);
+
+/* Zobrist hash of the position, updated incrementally */
+uint64_t board_hash(const board_t *board);
+
+/*
+  Removing one chip changes selectability of at most 15 columns
+  (3 rows by 5 columns around it), so a pair touches at most 30.
+*/
+#define MOVE_MAX_DELTA 30
+
+typedef struct {
+  position_t positions[2];
+  chip_t chips[2];
+  int chip_count;
+  int selectable_count;
+  uint64_t hash;
+  int delta_count;
+  struct {
+    unsigned char y, x;
+    unsigned char selectable;
+  } delta[MOVE_MAX_DELTA];
+} move_t;
+
+void board_remove_pair(board_t *board, position_t pos1, position_t pos2, move_t *move);
+void board_restore_pair(board_t *board, const move_t *move);
 
 /*******************************************************/
 
@@ -49,5 +107,8 @@ typedef struct tag_map {
 
 void generate_board(board_t *board, map_t *map);
 
+/* deals remaining chips over remaining slots so that the position is solvable again */
+int board_reshuffle(board_t *board);
+
 #endif
 
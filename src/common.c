@@ -1,4 +1,5 @@
 #include <string.h>
+#include <time.h>
 
 #include "common.h"
 
@@ -17,6 +18,13 @@ int rrand(int m)
   return rand() % m;
 }
 
+int64_t clock_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 void shuffle(void *array, size_t nmemb, size_t size)
 {
   void *temp = malloc(size);
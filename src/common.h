@@ -2,6 +2,7 @@
 #define COMMON_H
 
 #include <stdlib.h>
+#include <stdint.h>
 
 #define SCREEN_WIDTH (ScreenWidth())
 #define SCREEN_HEIGHT (ScreenHeight())
@@ -18,6 +19,9 @@ static inline int max_int(int x, int y)
 
 int rrand(int m);
 
+/* monotonic clock in microseconds, 64-bit as long is 32 bits on the device */
+int64_t clock_us(void);
+
 void shuffle(void *obj, size_t nmemb, size_t size);
 void topological_sort(void *array, size_t nmemb, size_t size, int (*has_edge)(const void*, const void*));
 
@@ -0,0 +1,93 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "config.h"
+
+static int is_space(char c)
+{
+  return c == ' ' || c == '\t';
+}
+
+static int is_key(char c)
+{
+  return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '_';
+}
+
+static int is_value(char c)
+{
+  return c != '\0' && c != '\n' && c != '\r' && !is_space(c);
+}
+
+/* splits "key = value" in place; the rest of the line is ignored */
+static void parse_line(char *line, config_handler_t handler)
+{
+  char *key, *key_end, *value;
+  char *p = line;
+
+  while (is_space(*p))
+    ++p;
+  key = p;
+  while (is_key(*p))
+    ++p;
+  if (p == key)
+    return;
+  key_end = p;
+
+  while (is_space(*p))
+    ++p;
+  if (*p++ != '=')
+    return;
+  *key_end = '\0';
+
+  while (is_space(*p))
+    ++p;
+  value = p;
+  while (is_value(*p))
+    ++p;
+  if (p == value)
+    return;
+  *p = '\0';
+
+  handler(key, value);
+}
+
+int config_read(const char *path, config_handler_t handler)
+{
+  char buf[CONFIG_MAX_SIZE + 1];
+  char *line, *end;
+  ssize_t size;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0)
+    return 0;
+  size = read(fd, buf, CONFIG_MAX_SIZE);
+  close(fd);
+  if (size < 0)
+    return 0;
+  buf[size] = '\0';
+
+  for (line = buf; *line != '\0'; line = end)
+    {
+      for (end = line; *end != '\0' && *end != '\n'; ++end)
+	;
+      if (*end == '\n')
+	*end++ = '\0';
+      parse_line(line, handler);
+    }
+  return 1;
+}
+
+int config_int(const char *value, int min, int max, int def)
+{
+  int n = 0;
+
+  if (*value == '\0')
+    return def;
+  for (; *value != '\0'; ++value)
+    {
+      if (*value < '0' || *value > '9' || n > max)
+	return def;
+      n = n * 10 + (*value - '0');
+    }
+  return n >= min && n <= max ? n : def;
+}
@@ -0,0 +1,20 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+/*
+  Settings file: one "key = value" per line.  The file is read into a
+  fixed buffer and split in place, so nothing is allocated.  Lines that
+  do not parse are skipped.
+*/
+
+#define CONFIG_MAX_SIZE (1024)
+
+typedef void (*config_handler_t)(const char *key, const char *value);
+
+/* calls handler for every setting, returns 0 if the file cannot be read */
+int config_read(const char *path, config_handler_t handler);
+
+/* value as a number in [min, max], or def if it is not one */
+int config_int(const char *value, int min, int max, int def);
+
+#endif
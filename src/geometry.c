@@ -47,3 +47,9 @@ int point_in_rect(int x, int y, const struct rect* r)
     (y >= r->y && y < r->y + r->h);
 }
 
+int rects_intersect(const struct rect* r1, const struct rect* r2)
+{
+  return
+    r1->x < r2->x + r2->w && r2->x < r1->x + r1->w &&
+    r1->y < r2->y + r2->h && r2->y < r1->y + r1->h;
+}
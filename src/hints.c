@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include "hints.h"
+#include "trace.h"
+
+#define HINTS_CACHE_SIZE 8
+
+static hints_t g_cache[HINTS_CACHE_SIZE];
+static int g_cache_used = 0;
+static int g_cache_next = 0;
+
+static int g_freed[MAX_HINTS];
+
+const hints_t* hints_lookup(const board_t *board)
+{
+  int i;
+  const uint64_t hash = board_hash(board);
+
+  for (i = 0; i < g_cache_used; ++i)
+    if (g_cache[i].hash == hash)
+      return &g_cache[i];
+  return NULL;
+}
+
+/* number of chips a move would make selectable */
+static int freed_by(board_t *board, position_t pos1, position_t pos2)
+{
+  int i;
+  int freed = 0;
+  move_t move;
+
+  board_remove_pair(board, pos1, pos2, &move);
+  for (i = 0; i < move.delta_count; ++i)
+    if (move.delta[i].selectable == 0)
+      ++freed;
+  board_restore_pair(board, &move);
+
+  return freed;
+}
+
+static void compute(board_t *board, const positions_t *selectable, hints_t *hints)
+{
+  int i, j, n;
+
+  hints->hash = board_hash(board);
+  hints->count = 0;
+
+  for (i = 0; i < selectable->count - 1; ++i)
+    {
+      const chip_t chip1 = board_get(board, selectable->positions[i]);
+      for (j = i + 1; j < selectable->count; ++j)
+	{
+	  const chip_t chip2 = board_get(board, selectable->positions[j]);
+	  if (!chips_fit(chip1, chip2) || hints->count >= MAX_HINTS)
+	    continue;
+
+	  /* keep the list ordered by freed chips, best first; ties keep scan order */
+	  const int freed = freed_by(board, selectable->positions[i], selectable->positions[j]);
+	  for (n = hints->count; n > 0 && g_freed[n - 1] < freed; --n)
+	    {
+	      hints->pairs[n] = hints->pairs[n - 1];
+	      g_freed[n] = g_freed[n - 1];
+	    }
+	  hints->pairs[n].first = i;
+	  hints->pairs[n].second = j;
+	  g_freed[n] = freed;
+	  ++hints->count;
+	}
+    }
+}
+
+const hints_t* hints_get(board_t *board, const positions_t *selectable)
+{
+  hints_t *hints = (hints_t*)hints_lookup(board);
+  if (hints != NULL)
+    return hints;
+
+  hints = &g_cache[g_cache_next];
+  g_cache_next = (g_cache_next + 1) % HINTS_CACHE_SIZE;
+  if (g_cache_used < HINTS_CACHE_SIZE)
+    ++g_cache_used;
+
+  TRACE_BEGIN("hints");
+  compute(board, selectable, hints);
+  TRACE_END("hints");
+  return hints;
+}
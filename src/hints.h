@@ -0,0 +1,23 @@
+#ifndef HINTS_H
+#define HINTS_H
+
+#include "board.h"
+
+/* at most 6 pairs out of each of 36 groups of four fitting chips */
+#define MAX_HINTS 216
+
+typedef struct {
+  uint64_t hash;
+  int count;
+  struct {
+    unsigned char first, second; /* indices in the selectable list */
+  } pairs[MAX_HINTS];
+} hints_t;
+
+/* cached hints for the position or NULL */
+const hints_t* hints_lookup(const board_t *board);
+
+/* cached hints for the position, computed and stored on a miss */
+const hints_t* hints_get(board_t *board, const positions_t *selectable);
+
+#endif
@@ -0,0 +1,86 @@
+#include <stddef.h>
+
+#include "history.h"
+
+void history_start(history_t *history, const board_t *deal)
+{
+  int i, j, k;
+
+  history->slot_count = 0;
+  for (i = 0; i < MAX_ROW_COUNT; ++i)
+    for (j = 0; j < MAX_COL_COUNT; ++j)
+      for (k = 0; k < deal->heights[i][j]; ++k)
+	if (deal->columns[i][j].chips[k] && history->slot_count < HISTORY_MAX_SLOTS)
+	  {
+	    history->slots[history->slot_count] = position_make(i, j, k);
+	    history->chips[history->slot_count] = deal->columns[i][j].chips[k];
+	    ++history->slot_count;
+	  }
+  history->deal_hash = board_hash(deal);
+
+  history->count = 0;
+  history->length = 0;
+}
+
+/* slots are in board order */
+int history_slot(const history_t *history, position_t pos)
+{
+  int lo = 0;
+  int hi = history->slot_count;
+
+  while (lo < hi)
+    {
+      const int mid = (lo + hi) / 2;
+      if (history->slots[mid] == pos)
+	return mid;
+      if (history->slots[mid] < pos)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return -1;
+}
+
+const move_t *history_do(history_t *history, board_t *board, position_t pos1, position_t pos2)
+{
+  const int s1 = history_slot(history, pos1);
+  const int s2 = history_slot(history, pos2);
+  unsigned char *move;
+
+  if (s1 < 0 || s2 < 0 || history->count == HISTORY_MAX_MOVES)
+    return NULL;
+
+  move = history->moves[history->count];
+  if (history->count == history->length ||
+      !((move[0] == s1 && move[1] == s2) || (move[0] == s2 && move[1] == s1)))
+    {
+      move[0] = s1;
+      move[1] = s2;
+      history->length = history->count + 1;
+    }
+
+  board_remove_pair(board, pos1, pos2, &history->frames[history->count]);
+  return &history->frames[history->count++];
+}
+
+const move_t *history_undo(history_t *history, board_t *board)
+{
+  if (history->count == 0)
+    return NULL;
+
+  --history->count;
+  board_restore_pair(board, &history->frames[history->count]);
+  return &history->frames[history->count];
+}
+
+const move_t *history_redo(history_t *history, board_t *board)
+{
+  const unsigned char *move;
+
+  if (history->count == history->length)
+    return NULL;
+
+  move = history->moves[history->count];
+  board_remove_pair(board, history->slots[move[0]], history->slots[move[1]], &history->frames[history->count]);
+  return &history->frames[history->count++];
+}
@@ -0,0 +1,42 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "board.h"
+
+/* a game removes at most 144 chips */
+#define HISTORY_MAX_SLOTS (144)
+#define HISTORY_MAX_MOVES (HISTORY_MAX_SLOTS / 2)
+
+/*
+  Moves of a game as pairs of slots, two bytes a move.  Slots number the
+  chips of the deal in board order, so the moves stay valid whatever the
+  chips are.  Moves from count up to length were undone and can be
+  redone until a different move is made.  Moves in effect keep their
+  undo frames, so every step back or forward is incremental.
+*/
+typedef struct {
+  int slot_count;
+  position_t slots[HISTORY_MAX_SLOTS];
+  chip_t chips[HISTORY_MAX_SLOTS];
+  uint64_t deal_hash;
+
+  int count;
+  int length;
+  unsigned char moves[HISTORY_MAX_MOVES][2];
+  move_t frames[HISTORY_MAX_MOVES];
+} history_t;
+
+/* takes the board as the deal, without any moves */
+void history_start(history_t *history, const board_t *deal);
+
+/* slot of the chip at pos in the deal, or -1 */
+int history_slot(const history_t *history, position_t pos);
+
+/* removes the pair from the board; drops the undone moves unless it is the next of them */
+const move_t *history_do(history_t *history, board_t *board, position_t pos1, position_t pos2);
+
+/* frame of the move taken back or made again, NULL if there is none */
+const move_t *history_undo(history_t *history, board_t *board);
+const move_t *history_redo(history_t *history, board_t *board);
+
+#endif
@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "journal.h"
+
+/*
+  "PBMJ", version, rows, columns, number of chips, then y, x, k and the
+  chip for each of them and the 64-bit hash of the deal, little endian.
+  Records follow: 'M' and the two slots for a move, 'U' for an undo and
+  'R' for a redo.  Slots number the chips in the order they are listed.
+*/
+#define JOURNAL_VERSION (2)
+#define JOURNAL_MOVE ('M')
+#define JOURNAL_UNDO ('U')
+#define JOURNAL_REDO ('R')
+#define JOURNAL_MOVE_SIZE (3)
+
+/* records appended before the file is rewritten */
+#define JOURNAL_SLACK (32)
+
+/* a rewrite holds at most every move and an undo for each, then come the appended records */
+#define JOURNAL_MAX_SIZE \
+  (8 + 4 * HISTORY_MAX_SLOTS + 8 + (JOURNAL_MOVE_SIZE + 1) * HISTORY_MAX_MOVES + JOURNAL_MOVE_SIZE * JOURNAL_SLACK)
+
+static char g_path[256];
+static int g_row_count;
+static int g_col_count;
+static int g_records = 0;
+
+static void put_hash(unsigned char *p, uint64_t hash)
+{
+  int i;
+  for (i = 0; i < 8; ++i)
+    p[i] = (hash >> (8 * i)) & 0xFF;
+}
+
+static uint64_t get_hash(const unsigned char *p)
+{
+  uint64_t hash = 0;
+  int i;
+  for (i = 0; i < 8; ++i)
+    hash |= (uint64_t)p[i] << (8 * i);
+  return hash;
+}
+
+static void append(const history_t *history, const unsigned char *data, size_t size)
+{
+  FILE *f;
+
+  if (g_path[0] == '\0')
+    return;
+
+  if (g_records >= JOURNAL_SLACK)
+    {
+      journal_save(g_path, g_row_count, g_col_count, history);
+      return;
+    }
+
+  f = fopen(g_path, "ab");
+  if (!f)
+    return;
+  fwrite(data, 1, size, f);
+  fclose(f);
+  ++g_records;
+}
+
+int journal_save(const char *path, int row_count, int col_count, const history_t *history)
+{
+  unsigned char buf[8 + 4 * HISTORY_MAX_SLOTS + 8 + (JOURNAL_MOVE_SIZE + 1) * HISTORY_MAX_MOVES];
+  char tmp[sizeof(g_path) + 4];
+  size_t size = 0;
+  int i;
+  FILE *f;
+
+  /* compaction passes g_path itself */
+  if (path != g_path)
+    snprintf(g_path, sizeof(g_path), "%s", path);
+  g_row_count = row_count;
+  g_col_count = col_count;
+  g_records = 0;
+
+  memcpy(buf, "PBMJ", 4);
+  buf[4] = JOURNAL_VERSION;
+  buf[5] = row_count;
+  buf[6] = col_count;
+  buf[7] = history->slot_count;
+  size = 8;
+  for (i = 0; i < history->slot_count; ++i)
+    {
+      buf[size++] = position_y(history->slots[i]);
+      buf[size++] = position_x(history->slots[i]);
+      buf[size++] = position_k(history->slots[i]);
+      buf[size++] = history->chips[i];
+    }
+  put_hash(buf + size, history->deal_hash);
+  size += 8;
+
+  /* every move, then undos back to the current one keep the redo tail */
+  for (i = 0; i < history->length; ++i)
+    {
+      buf[size++] = JOURNAL_MOVE;
+      buf[size++] = history->moves[i][0];
+      buf[size++] = history->moves[i][1];
+    }
+  for (i = history->count; i < history->length; ++i)
+    buf[size++] = JOURNAL_UNDO;
+
+  /* replace the old journal only once the new one is complete */
+  snprintf(tmp, sizeof(tmp), "%s.new", g_path);
+  f = fopen(tmp, "wb");
+  if (!f)
+    return 0;
+  if (fwrite(buf, 1, size, f) != size)
+    {
+      fclose(f);
+      remove(tmp);
+      return 0;
+    }
+  fclose(f);
+  if (rename(tmp, g_path))
+    {
+      remove(tmp);
+      return 0;
+    }
+  return 1;
+}
+
+void journal_move(const history_t *history)
+{
+  const unsigned char *move = history->moves[history->count - 1];
+  const unsigned char record[JOURNAL_MOVE_SIZE] = { JOURNAL_MOVE, move[0], move[1] };
+
+  append(history, record, sizeof(record));
+}
+
+void journal_undo(const history_t *history)
+{
+  const unsigned char record = JOURNAL_UNDO;
+  append(history, &record, 1);
+}
+
+void journal_redo(const history_t *history)
+{
+  const unsigned char record = JOURNAL_REDO;
+  append(history, &record, 1);
+}
+
+static int valid_slot(const board_t *board, const history_t *history, int slot)
+{
+  position_t pos;
+
+  if (slot >= history->slot_count)
+    return 0;
+  pos = history->slots[slot];
+  return board->selectable[position_y(pos)][position_x(pos)] == position_k(pos) + 1;
+}
+
+int journal_load(const char *path, board_t *board, int *row_count, int *col_count, history_t *history)
+{
+  /* replayed aside, the game in memory only changes once all of it checks out */
+  static unsigned char buf[JOURNAL_MAX_SIZE];
+  static board_t loaded;
+  static history_t replayed;
+  const unsigned char *p = buf;
+  const unsigned char *end;
+  size_t size;
+  int i;
+  int records = 0;
+  FILE *f = fopen(path, "rb");
+
+  if (!f)
+    return 0;
+
+  /* the whole file in one read; anything past the bound counts as cut short */
+  size = fread(buf, 1, sizeof(buf), f);
+  fclose(f);
+  end = buf + size;
+
+  if (size < 8 || memcmp(buf, "PBMJ", 4) || buf[4] != JOURNAL_VERSION ||
+      buf[5] == 0 || buf[5] > MAX_ROW_COUNT || buf[6] == 0 || buf[6] > MAX_COL_COUNT ||
+      size < 8 + 4 * (size_t)buf[7] + 8)
+    return 0;
+  p += 8;
+
+  board_clear(&loaded);
+  for (i = 0; i < buf[7]; ++i, p += 4)
+    {
+      if (p[0] >= MAX_ROW_COUNT || p[1] >= MAX_COL_COUNT || p[2] >= MAX_HEIGHT)
+	return 0;
+      board_set(&loaded, position_make(p[0], p[1], p[2]), p[3]);
+    }
+  if (get_hash(p) != board_hash(&loaded))
+    return 0;
+  p += 8;
+
+  history_start(&replayed, &loaded);
+  while (p < end)
+    {
+      const int c = *p++;
+
+      if (c == JOURNAL_UNDO)
+	{
+	  if (!history_undo(&replayed, &loaded))
+	    return 0;
+	}
+      else if (c == JOURNAL_REDO)
+	{
+	  if (!history_redo(&replayed, &loaded))
+	    return 0;
+	}
+      else if (c == JOURNAL_MOVE)
+	{
+	  position_t pos1, pos2;
+
+	  /* a record cut short by a crash ends the journal */
+	  if (end - p < 2)
+	    break;
+	  if (p[0] == p[1] ||
+	      !valid_slot(&loaded, &replayed, p[0]) ||
+	      !valid_slot(&loaded, &replayed, p[1]))
+	    return 0;
+	  pos1 = replayed.slots[p[0]];
+	  pos2 = replayed.slots[p[1]];
+	  if (!chips_fit(board_get(&loaded, pos1), board_get(&loaded, pos2)) ||
+	      !history_do(&replayed, &loaded, pos1, pos2))
+	    return 0;
+	  p += 2;
+	}
+      else
+	return 0;
+      ++records;
+    }
+
+  *board = loaded;
+  *history = replayed;
+  snprintf(g_path, sizeof(g_path), "%s", path);
+  *row_count = g_row_count = buf[5];
+  *col_count = g_col_count = buf[6];
+  g_records = records;
+  return 1;
+}
+
+void journal_remove(void)
+{
+  if (g_path[0] != '\0')
+    remove(g_path);
+  g_path[0] = '\0';
+  g_records = 0;
+}
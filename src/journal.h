@@ -0,0 +1,27 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "board.h"
+#include "history.h"
+
+/*
+  Saved game kept up to date after every move.  The file holds the deal
+  (the chips on the board before the first move, with its hash) and then
+  one small record per move, undo or redo, appended as they happen.  Once
+  records pile up the file is rewritten from the history.
+*/
+
+/* writes the journal for the history, undone moves included */
+int journal_save(const char *path, int row_count, int col_count, const history_t *history);
+
+/* append the step just taken on the history */
+void journal_move(const history_t *history);
+void journal_undo(const history_t *history);
+void journal_redo(const history_t *history);
+
+/* replays the journal; returns 0 if there is none or it does not check out */
+int journal_load(const char *path, board_t *board, int *row_count, int *col_count, history_t *history);
+
+void journal_remove(void);
+
+#endif
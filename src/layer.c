@@ -0,0 +1,56 @@
+#include <stdlib.h>
+#include <string.h>
+#include "inkview.h"
+
+#include "layer.h"
+
+int layer_resize(layer_t *layer, int width, int height)
+{
+  layer_free(layer);
+  layer->bitmap = malloc(sizeof(ibitmap) + width * height);
+  if (layer->bitmap == NULL)
+    return 0;
+
+  layer->bitmap->width = width;
+  layer->bitmap->height = height;
+  layer->bitmap->depth = 8;
+  layer->bitmap->scanline = width;
+
+  memset(&layer->canvas, 0, sizeof(layer->canvas));
+  layer->canvas.width = width;
+  layer->canvas.height = height;
+  layer->canvas.scanline = width;
+  layer->canvas.depth = 8;
+  layer->canvas.clipx2 = width - 1;
+  layer->canvas.clipy2 = height - 1;
+  layer->canvas.addr = layer->bitmap->data;
+  return 1;
+}
+
+void layer_free(layer_t *layer)
+{
+  free(layer->bitmap);
+  layer->bitmap = NULL;
+}
+
+int layer_fits(const layer_t *layer, int width, int height)
+{
+  return layer->bitmap != NULL && layer->bitmap->width == width && layer->bitmap->height == height;
+}
+
+void layer_begin(layer_t *layer, int x, int y, int w, int h)
+{
+  layer->saved = GetCanvas();
+  SetCanvas(&layer->canvas);
+  SetClip(x, y, w, h);
+}
+
+void layer_end(layer_t *layer)
+{
+  SetCanvas(layer->saved);
+}
+
+void layer_draw(const layer_t *layer, int x, int y)
+{
+  DrawBitmap(x, y, layer->bitmap);
+}
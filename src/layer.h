@@ -0,0 +1,29 @@
+#ifndef LAYER_H
+#define LAYER_H
+
+#include "inkview.h"
+
+/*
+  Offscreen 8-bit canvas.  Drawing between layer_begin() and layer_end()
+  goes to the layer instead of the screen; layer_draw() copies it back.
+*/
+typedef struct {
+  ibitmap *bitmap;
+  icanvas canvas;
+  icanvas *saved;
+} layer_t;
+
+/* contents are undefined afterwards; returns 0 if the layer could not be allocated */
+int layer_resize(layer_t *layer, int width, int height);
+void layer_free(layer_t *layer);
+
+/* whether the layer is allocated with the given size */
+int layer_fits(const layer_t *layer, int width, int height);
+
+/* drawing is clipped to x, y, w, h */
+void layer_begin(layer_t *layer, int x, int y, int w, int h);
+void layer_end(layer_t *layer);
+
+void layer_draw(const layer_t *layer, int x, int y);
+
+#endif
@@ -2,7 +2,6 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <regex.h>
 #include "inkview.h"
 
 #include "common.h"
@@ -12,12 +11,29 @@
 #include "geometry.h"
 #include "menu.h"
 #include "messages.h"
+#include "hints.h"
+#include "rating.h"
+#include "refresh.h"
+#include "nav.h"
+#include "layer.h"
+#include "pixels.h"
+#include "history.h"
+#include "journal.h"
+#include "config.h"
+#include "startup.h"
+#include "trace.h"
 
 #ifdef EMULATION
 #undef STATEPATH
 #define STATEPATH "."
 #endif
 
+#define STATE_PATH (STATEPATH "/pb-mahjong")
+#define JOURNAL_PATH (STATEPATH "/pb-mahjong.journal")
+#define STARTUP_LOG_PATH (STATEPATH "/pb-mahjong.startup.log")
+#define TRACE_PATH (STATEPATH "/pb-mahjong.trace.json")
+
+/* games saved on exit by older versions */
 #define SAVED_GAME_PATH (STATEPATH "/pb-mahjong.saved-game")
 
 static int orientation = ROTATE270;
@@ -26,108 +42,154 @@ static int row_count;
 static int col_count;
 static int caret_pos;
 static int selection_pos = -1;
-static positions_t *g_selectable = NULL;
-static int help_index = 0;
-static int help_offset = 0;
+static nav_t g_nav;
+static positions_t *g_selectable = &g_nav.list;
+static int hint_cursor = 0;
 static int game_active = 0;
+static difficulty_t difficulty = DIFFICULTY_ANY;
+
+/* settings only changed by editing the state file */
+static int refresh_budget = REFRESH_DEFAULT_BUDGET;
+static map_t *start_map = NULL; /* new game opened instead of the main menu */
+static int background_hints = 1;
+static int menu_cache_size = MENU_LAYOUT_CACHE_SIZE;
+static int board_cache = 1;
+static int startup_log = 0;
 
 extern const ibitmap background;
 
 #define HELP_HEIGHT (20)
+#define HINTS_DELAY (300)
 
 static void menu_handler(int index);
 static void read_state(void);
 static void write_state(void);
 static int load_game(void);
-static void save_game(void);
 
-static struct
-{
-  position_t positions[144];
-  chip_t chips[144];
-  int count;
-} undo_stack;
+static history_t g_history;
 
-static int cmp_pos(const void *p1, const void *p2)
+static void precompute_hints(void)
 {
-  const position_t *pos1 = p1;
-  const position_t *pos2 = p2;
-  return ((pos1->y - 1) / 2 * MAX_COL_COUNT + pos1->x)
-    - ((pos2->y - 1) / 2 * MAX_COL_COUNT + pos2->x);
+  if (game_active)
+    hints_get(&g_board, g_selectable);
 }
 
-static void rebuild_selectables(void)
-{
-  if (g_selectable != NULL)
-    free(g_selectable);
+/*
+  Offscreen copy of the board without caret and selection.  After a move
+  only the chips around the removed (or restored) pair are redrawn.
+*/
+static layer_t board_layer;
+static int board_layer_valid = 0;
+static position_t board_layer_dirty[4];
+static int board_layer_dirty_count = 0;
 
-  g_selectable = get_selectable_positions(&g_board);
-  qsort(&g_selectable->positions[0], g_selectable->count, sizeof(position_t), cmp_pos);
+static void invalidate_board_layer(void)
+{
+  board_layer_valid = 0;
+  board_layer_dirty_count = 0;
+}
 
-  help_index = 0;
-  help_offset = 0;
+static void board_layer_move(const move_t *move)
+{
+  if (board_layer_dirty_count + 2 > 4)
+    {
+      invalidate_board_layer();
+      return;
+    }
+  board_layer_dirty[board_layer_dirty_count++] = move->positions[0];
+  board_layer_dirty[board_layer_dirty_count++] = move->positions[1];
 }
 
-static void undo()
+static void selectables_changed(void)
 {
-  int i;
+  hint_cursor = 0;
+  if (background_hints)
+    SetWeakTimer("hints", precompute_hints, HINTS_DELAY);
+}
 
-  if (undo_stack.count == 0)
-    return;
+static void rebuild_selectables(void)
+{
+  TRACE_SCOPE("rebuild_selectables");
+  nav_build(&g_nav, &g_board);
+  selectables_changed();
+}
 
-  for (i = 0; i < 2; ++i)
-    {
-      board_set( &g_board, &undo_stack.positions[undo_stack.count - 1], undo_stack.chips[undo_stack.count - 1]);
-      --undo_stack.count;
-    }
+/* after the move was made or taken back */
+static void patch_selectables(const move_t *move)
+{
+  TRACE_SCOPE("patch_selectables");
+  nav_update(&g_nav, &g_board, move);
+  selectables_changed();
+}
 
+/* after a step through the history */
+static void history_changed(const move_t *move)
+{
   selection_pos = -1;
-  rebuild_selectables();
+  patch_selectables(move);
+  board_layer_move(move);
 
   // find caret pos
   if (caret_pos >= g_selectable->count)
     caret_pos = g_selectable->count - 1;
 }
 
-static void clear_undo_stack()
+static void undo()
 {
-  undo_stack.count = 0;
+  const move_t *move = history_undo(&g_history, &g_board);
+  if (!move)
+    return;
+
+  history_changed(move);
+  journal_undo(&g_history);
+}
+
+static void redo()
+{
+  const move_t *move = history_redo(&g_history, &g_board);
+  if (!move)
+    return;
+
+  history_changed(move);
+  journal_redo(&g_history);
+}
+
+/* one step at a time, so each only touches the chips around its pair */
+static void jump_to_move(int n)
+{
+  while (g_history.count > n)
+    undo();
+  while (g_history.count < n && g_history.count < g_history.length)
+    redo();
 }
 
 static void start_game(void)
 {
   rebuild_selectables();
+  invalidate_board_layer();
   caret_pos = 0;
   selection_pos = -1;
   game_active = 1;
-  unlink(SAVED_GAME_PATH);
 }
 
-static void init_map(map_t *map)
+static void save_game(void)
 {
-  clear_undo_stack();
+  TRACE_SCOPE("save_game");
+  journal_save(JOURNAL_PATH, row_count, col_count, &g_history);
+}
 
-  generate_board(&g_board, map);
+static void init_map(map_t *map)
+{
+  generate_rated_board(&g_board, map, difficulty);
   row_count = map->row_count;
   col_count = map->col_count;
+  history_start(&g_history, &g_board);
 
   start_game();
+  save_game();
 }
 
-static int fits(chip_t a, chip_t b)
-{
-  int category = a & 0xC0;
-  if (category == 0xC0) /*flowers*/
-    {
-      return (a & 0xF0) == (b & 0xF0);
-    }
-  else
-    {
-      return a == b;
-    }
-}
-
-static void cell_rect(const position_t *pos, struct rect *r)
+static void cell_rect(position_t pos, struct rect *r)
 {
 #define IMG_WIDTH (55)
 #define IMG_HEIGHT (79)
@@ -153,75 +215,65 @@ static void cell_rect(const position_t *pos, struct rect *r)
   offset_x = (screen_width - w * col_count) / 2;
   offset_y = (screen_height - h * row_count) / 2;
 
-  r->x = offset_x + pos->x * w + 4 * pos->k;
-  r->y = offset_y + pos->y * h + 4 * pos->k;
+  r->x = offset_x + position_x(pos) * w + 4 * position_k(pos);
+  r->y = offset_y + position_y(pos) * h + 4 * position_k(pos);
   r->w = 2 * w;
   r->h = 2 * h;
 }
 
+/* cell rect together with the bevel drawn above and to the left of it */
+static void chip_rect(position_t pos, struct rect *r)
+{
+  cell_rect(pos, r);
+  r->x -= 4;
+  r->y -= 4;
+  r->w += 4;
+  r->h += 4;
+}
+
+static void status_rect(struct rect *r)
+{
+  r->x = 0;
+  r->y = ScreenHeight() - HELP_HEIGHT;
+  r->w = ScreenWidth();
+  r->h = HELP_HEIGHT;
+}
+
 static void draw_caret(const struct rect *r, int color)
 {
-  DrawRect(r->x + 2, r->y + 2, r->w - 4, r->h - 4, color);
-  DrawRect(r->x + 3, r->y + 3, r->w - 6, r->h - 6, color);
-  DrawRect(r->x + 4, r->y + 4, r->w - 8, r->h - 8, color);
-  DrawRect(r->x + 5, r->y + 5, r->w - 10, r->h - 10, color);
-  DrawRect(r->x + 6, r->y + 6, r->w - 12, r->h - 12, color);
+  pixels_frame(r->x + 2, r->y + 2, r->w - 4, r->h - 4, 5, color);
 }
 
-static void draw_chip(const position_t *pos, chip_t chip)
+static void draw_chip(position_t pos, chip_t chip)
 {
-  int i;
   struct rect r;
 
   cell_rect(pos, &r);
-  DrawRect(r.x - 4, r.y - 4, r.w, r.h, DGRAY);
-
-  for (i = 0; i < 3; ++i)
-    {
-      DrawLine(r.x - 1 - i, r.y - 1 - i, r.x - 1 - i, r.y - 1 - i + r.h - 1, LGRAY);
-      DrawLine(r.x - 1 - i, r.y - 1 - i, r.x - 1 - i + r.w - 1, r.y - 1 - i, LGRAY);
-    }
-  DrawLine(r.x - 4, r.y - 4, r.x, r.y, DGRAY);
-  DrawLine(r.x - 4 + r.w - 1, r.y - 4, r.x + r.w - 1, r.y, DGRAY);
-  DrawLine(r.x - 4, r.y - 4 + r.h - 1, r.x, r.y + r.h - 1, DGRAY);
-
-  FillArea(r.x, r.y, r.w, r.h, WHITE);
-  DrawRect(r.x, r.y, r.w, r.h, DGRAY);
+  pixels_tile(r.x, r.y, r.w, r.h, 4, LGRAY, DGRAY);
 
-  StretchBitmap(r.x + 1, r.y + 1, r.w - 2, r.h - 2, (ibitmap*)bitmaps[chip], 0);
-
-  if (caret_pos >= 0 && caret_pos < g_selectable->count)
-    {
-      if (position_equal(pos, &g_selectable->positions[caret_pos]))
-	draw_caret(&r, DGRAY);
-    }
-
-  if (selection_pos >= 0 && selection_pos < g_selectable->count)
-    {
-      position_t *selection = &g_selectable->positions[selection_pos];
-      if (position_equal(pos, selection))
-	InvertArea(r.x + 1, r.y + 1, r.w - 2, r.h - 2);
-    }
+  draw_chip_face(chip, r.x + 1, r.y + 1, r.w - 2, r.h - 2);
 }
 
 static int is_covered_by(const void *p1, const void *p2)
 {
-  const position_t *s1 = p1;
-  const position_t *s2 = p2;
+  const position_t s1 = *(const position_t*)p1;
+  const position_t s2 = *(const position_t*)p2;
+  const int y1 = position_y(s1), x1 = position_x(s1);
+  const int y2 = position_y(s2), x2 = position_x(s2);
 
-  if (s1->k < s2->k)
+  if (position_k(s1) < position_k(s2))
     return 1;
-  if (s1->k > s2->k)
+  if (position_k(s1) > position_k(s2))
     return 0;
 
-  if (s2->y >= s1->y + 2)
+  if (y2 >= y1 + 2)
     return 0;
 
-  if (abs(s2->y - s1->y) <= 1)
-    return s2->x < s1->x;
+  if (abs(y2 - y1) <= 1)
+    return x2 < x1;
 
-  if (s2->y == s1->y - 2)
-    return s2->x >= s1->x - 2 && s2->x < s1->x - 2;
+  if (y2 == y1 - 2)
+    return x2 >= x1 - 2 && x2 < x1 + 2;
 
   return 0;
 }
@@ -234,7 +286,8 @@ static ifont *get_help_font(void)
   return g_help_font;
 }
 
-static void main_repaint(void)
+/* draws the chips overlapping clip bottom up, all of them if clip is NULL */
+static void draw_chips(const struct rect *clip)
 {
   int i, j, k;
   position_t chips[144];
@@ -242,34 +295,101 @@ static void main_repaint(void)
 
   for (i = 0; i < MAX_ROW_COUNT; ++i)
     for (j = 0; j < MAX_COL_COUNT; ++j)
-      for (k = 0; k < MAX_HEIGHT; ++k)
-	{
-	  const chip_t chip = g_board.columns[i][j].chips[k];
-	  if (chip)
-	    {
-	      chips[chip_count].x = j;
-	      chips[chip_count].y = i;
-	      chips[chip_count].k = k;
-	      ++chip_count;
-	    }
-	}
-  topological_sort(chips, chip_count, sizeof(position_t), is_covered_by);
+      for (k = 0; k < g_board.heights[i][j]; ++k)
+	if (g_board.columns[i][j].chips[k])
+	  {
+	    const position_t pos = position_make(i, j, k);
 
-  ClearScreen();
+	    chips[chip_count] = pos;
+	    if (clip != NULL)
+	      {
+		struct rect r;
+		chip_rect(pos, &r);
+		if (!rects_intersect(&r, clip))
+		  continue;
+	      }
+	    ++chip_count;
+	  }
+  topological_sort(chips, chip_count, sizeof(position_t), is_covered_by);
 
   for (i = chip_count - 1; i >= 0; --i)
     {
-      const position_t *pos = &chips[i];
-      draw_chip(pos, board_get(&g_board, pos));
+      draw_chip(chips[i], board_get(&g_board, chips[i]));
+    }
+}
+
+/* brings the board layer up to date, returns 0 if there is no layer */
+static int update_board_layer(void)
+{
+  const int width = ScreenWidth();
+  const int height = ScreenHeight();
+  int i;
+  TRACE_SCOPE("update_board_layer");
+
+  if (!board_cache)
+    return 0;
+
+  if (!layer_fits(&board_layer, width, height))
+    {
+      invalidate_board_layer();
+      if (!layer_resize(&board_layer, width, height))
+	return 0;
+    }
+
+  if (!board_layer_valid)
+    {
+      layer_begin(&board_layer, 0, 0, width, height);
+      ClearScreen();
+      draw_chips(NULL);
+      layer_end(&board_layer);
+      board_layer_valid = 1;
+    }
+
+  for (i = 0; i < board_layer_dirty_count; ++i)
+    {
+      struct rect r;
+      chip_rect(board_layer_dirty[i], &r);
+      layer_begin(&board_layer, r.x, r.y, r.w, r.h);
+      pixels_fill(r.x, r.y, r.w, r.h, WHITE);
+      draw_chips(&r);
+      layer_end(&board_layer);
+    }
+  board_layer_dirty_count = 0;
+
+  return 1;
+}
+
+static void main_repaint(void)
+{
+  int i, j;
+  TRACE_SCOPE("main_repaint");
+
+  if (update_board_layer())
+    layer_draw(&board_layer, 0, 0);
+  else
+    {
+      ClearScreen();
+      draw_chips(NULL);
+    }
+
+  if (caret_pos >= 0 && caret_pos < g_selectable->count)
+    {
+      struct rect r;
+      cell_rect(g_selectable->positions[caret_pos], &r);
+      draw_caret(&r, DGRAY);
+    }
+
+  if (selection_pos >= 0 && selection_pos < g_selectable->count)
+    {
+      struct rect r;
+      cell_rect(g_selectable->positions[selection_pos], &r);
+      pixels_invert(r.x + 1, r.y + 1, r.w - 2, r.h - 2);
     }
 
   /* status bar */
   {
     struct rect r;
-    r.x = 0;
-    r.y = ScreenHeight() - HELP_HEIGHT;
-    r.w = ScreenWidth();
-    r.h = HELP_HEIGHT;
+    status_rect(&r);
 
     DrawLine(r.x, r.y, r.x + r.w, r.y, BLACK);
     FillArea(r.x, r.y + 2, r.w, r.h - 2, DGRAY);
@@ -283,16 +403,20 @@ static void main_repaint(void)
 
     {
       int pairs = 0;
-      for (i = 0; i < g_selectable->count - 1; ++i)
-	{
-	  const chip_t chip1 = board_get(&g_board, &g_selectable->positions[i]);
-	  for (j = i + 1; j < g_selectable->count; ++j)
-	    {
-	      const chip_t chip2 = board_get(&g_board, &g_selectable->positions[j]);
-	      if (fits(chip1, chip2))
-		++pairs;
-	    }
-	}
+      const hints_t *hints = hints_lookup(&g_board);
+      if (hints != NULL)
+	pairs = hints->count;
+      else
+	for (i = 0; i < g_selectable->count - 1; ++i)
+	  {
+	    const chip_t chip1 = board_get(&g_board, g_selectable->positions[i]);
+	    for (j = i + 1; j < g_selectable->count; ++j)
+	      {
+		const chip_t chip2 = board_get(&g_board, g_selectable->positions[j]);
+		if (chips_fit(chip1, chip2))
+		  ++pairs;
+	      }
+	  }
 
       char buffer[256];
       snprintf(buffer, 256, get_message(MSG_MOVES_LEFT), pairs);
@@ -305,122 +429,94 @@ static void main_repaint(void)
 
 static int move_left(void)
 {
-  if (caret_pos > 0)
-    --caret_pos;
-  else
-    caret_pos = g_selectable->count - 1;
+  caret_pos = g_nav.left[caret_pos];
   return 1;
 }
 
 static int move_right(void)
 {
-  if (caret_pos < g_selectable->count - 1)
-    ++caret_pos;
-  else
-    caret_pos = 0;
+  caret_pos = g_nav.right[caret_pos];
   return 1;
 }
 
 static int move_up(void)
 {
-  int i;
-  int min_dist = INT_MAX;
-  int new_pos = caret_pos;
-
-  const position_t *caret = &g_selectable->positions[caret_pos];
-  const int caret_row = (caret->y - 1) / 2;
-
-  for (i = 0; i < g_selectable->count; ++i)
-    if (i != caret_pos)
-      {
-	const position_t *pos = &g_selectable->positions[i];
-	int pos_row = (pos->y - 1) / 2;
-	if (caret_row <= pos_row)
-	  pos_row -= MAX_COL_COUNT;
-
-	const int dist = abs(caret_row - pos_row) * MAX_COL_COUNT + abs(caret->x - pos->x);
-	if (dist < min_dist)
-	  {
-	    new_pos = i;
-	    min_dist = dist;
-	  }
-      }
-
-  if (new_pos != caret_pos)
-    {
-      caret_pos = new_pos;
-      return 1;
-    }
-  return 0;
+  if (g_nav.up[caret_pos] == caret_pos)
+    return 0;
+  caret_pos = g_nav.up[caret_pos];
+  return 1;
 }
 
 static int move_down(void)
 {
-  int i;
-  int min_dist = INT_MAX;
-  int new_pos = caret_pos;
-
-  const position_t *caret = &g_selectable->positions[caret_pos];
-  const int caret_row = (caret->y - 1) / 2;
+  if (g_nav.down[caret_pos] == caret_pos)
+    return 0;
+  caret_pos = g_nav.down[caret_pos];
+  return 1;
+}
 
-  for (i = 0; i < g_selectable->count; ++i)
-    if (i != caret_pos)
-      {
-	const position_t *pos = &g_selectable->positions[i];
-        int pos_row = (pos->y - 1) / 2;
-	if (caret_row >= pos_row)
-	  pos_row += MAX_COL_COUNT;
+/*
+  Caret moves only update the model; the board is repainted by a zero
+  delay timer, which fires once the queued navigation events (held keys
+  repeat quickly) are drained, so only the final caret gets rendered.
+*/
+static int caret_pending = 0;
+static position_t caret_shown;
 
-	const int dist = abs(caret_row - pos_row) * MAX_COL_COUNT + abs(caret->x - pos->x);
-	if (dist < min_dist)
-	  {
-	    new_pos = i;
-	    min_dist = dist;
-	  }
-      }
+static void show_caret(void)
+{
+  struct rect r;
 
-  if (new_pos != caret_pos)
-    {
-      caret_pos = new_pos;
-      return 1;
-    }
-  return 0;
+  if (!caret_pending)
+    return;
+  caret_pending = 0;
+  ClearTimer(show_caret);
+
+  main_repaint();
+  cell_rect(caret_shown, &r);
+  refresh_partial(r.x, r.y, r.w, r.h);
+  cell_rect(g_selectable->positions[caret_pos], &r);
+  refresh_partial(r.x, r.y, r.w, r.h);
+  refresh_flush();
 }
 
 static void generic_move(int (*move_func)(void))
 {
-  int prev_caret_pos = caret_pos;
+  const position_t prev_caret = g_selectable->positions[caret_pos];
   if (move_func())
     {
-      struct rect r1;
-      struct rect r2;
-      struct rect r;
-
-      main_repaint();
-      cell_rect(&g_selectable->positions[prev_caret_pos], &r1);
-      cell_rect(&g_selectable->positions[caret_pos], &r2);
-      union_rect(&r1, &r2, &r);
+      if (!caret_pending)
+	{
+	  caret_shown = prev_caret;
+	  caret_pending = 1;
+	}
+      SetHardTimer("caret", show_caret, 0);
+    }
+}
 
-      PartialUpdate(r.x, r.y, r.w, r.h);
+static int navigate(int key)
+{
+  switch (key)
+    {
+    case KEY_LEFT:
+      generic_move(move_left);
+      return 1;
+    case KEY_RIGHT:
+      generic_move(move_right);
+      return 1;
+    case KEY_UP:
+      generic_move(move_up);
+      return 1;
+    case KEY_DOWN:
+      generic_move(move_down);
+      return 1;
     }
+  return 0;
 }
 
 static int finished(void)
 {
-  int i, j, k;
-
-  for (i = 0; i < MAX_ROW_COUNT; ++i)
-    for (j = 0; j < MAX_COL_COUNT; ++j)
-      for (k = 0; k < MAX_HEIGHT; ++k)
-	{
-	  position_t pos;
-	  pos.y = i;
-	  pos.x = j;
-	  pos.k = k;
-	  if (board_get(&g_board, &pos) != 0)
-	    return 0;
-	}
-  return 1;
+  return g_board.chip_count == 0;
 }
 
 static int pair_exists(board_t *board)
@@ -429,76 +525,96 @@ static int pair_exists(board_t *board)
 
   for (i = 0; i < g_selectable->count - 1; ++i)
     {
-      const chip_t chip1 = board_get(board, &g_selectable->positions[i]);
+      const chip_t chip1 = board_get(board, g_selectable->positions[i]);
       for (j = i + 1; j < g_selectable->count; ++j)
 	{
-	  const chip_t chip2 = board_get(board, &g_selectable->positions[j]);
-	  if (fits(chip1, chip2))
+	  const chip_t chip2 = board_get(board, g_selectable->positions[j]);
+	  if (chips_fit(chip1, chip2))
 	    return 1;
 	}
     }
   return 0;
 }
 
+static message_id finish_menu[] = {
+  MSG_NEW_GAME_EASY,
+  MSG_NEW_GAME_DIFFICULT,
+  MSG_NEW_GAME_FOUR_BRIDGES,
+  MSG_SEPARATOR,
+  MSG_EXIT,
+  MSG_NONE
+};
+
+static message_id stuck_menu[] = {
+  MSG_RESHUFFLE,
+  MSG_SEPARATOR,
+  MSG_NEW_GAME_EASY,
+  MSG_NEW_GAME_DIFFICULT,
+  MSG_NEW_GAME_FOUR_BRIDGES,
+  MSG_SEPARATOR,
+  MSG_EXIT,
+  MSG_NONE
+};
+
 static void select_cell(void)
 {
   if (selection_pos == caret_pos)
     {
       struct rect r;
-      cell_rect(&g_selectable->positions[selection_pos], &r);
+      cell_rect(g_selectable->positions[selection_pos], &r);
       selection_pos = -1;
       main_repaint();
-      PartialUpdate(r.x, r.y, r.w, r.h);
+      refresh_partial(r.x, r.y, r.w, r.h);
       return;
     }
 
-  const chip_t chip1 = selection_pos >= 0 ? board_get(&g_board, &g_selectable->positions[selection_pos]) : 0;
-  const chip_t chip2 = board_get(&g_board, &g_selectable->positions[caret_pos]);
+  const chip_t chip1 = selection_pos >= 0 ? board_get(&g_board, g_selectable->positions[selection_pos]) : 0;
+  const chip_t chip2 = board_get(&g_board, g_selectable->positions[caret_pos]);
 
-  if (chip1 != 0 && fits(chip1, chip2))
+  if (chip1 != 0 && chips_fit(chip1, chip2))
     {
-      undo_stack.positions[undo_stack.count] = g_selectable->positions[selection_pos];
-      undo_stack.chips[undo_stack.count] = chip1;
-      ++undo_stack.count;
-      undo_stack.positions[undo_stack.count] = g_selectable->positions[caret_pos];
-      undo_stack.chips[undo_stack.count] = chip2;
-      ++undo_stack.count;
-
-      board_set(&g_board, &g_selectable->positions[selection_pos], 0);
-      board_set(&g_board, &g_selectable->positions[caret_pos], 0);
+      struct rect r1;
+      struct rect r2;
+      const move_t *move;
 
-      selection_pos = -1;
+      chip_rect(g_selectable->positions[selection_pos], &r1);
+      chip_rect(g_selectable->positions[caret_pos], &r2);
 
-      rebuild_selectables();
-      // find caret pos
-      if (caret_pos >= g_selectable->count)
-	caret_pos = g_selectable->count - 1;
+      /* a chip outside the deal or a full history leaves the board as it is */
+      move = history_do(&g_history, &g_board,
+			g_selectable->positions[selection_pos],
+			g_selectable->positions[caret_pos]);
+      if (move == NULL)
+	return;
 
-      static message_id finish_menu[] = {
-	MSG_NEW_GAME_EASY,
-	MSG_NEW_GAME_DIFFICULT,
-	MSG_NEW_GAME_FOUR_BRIDGES,
-	MSG_SEPARATOR,
-	MSG_EXIT,
-	MSG_NONE
-      };
+      history_changed(move);
+      journal_move(&g_history);
 
       if (finished())
 	{
 	  game_active = 0;
-	  clear_undo_stack();
+	  journal_remove();
 	  show_popup(&background, MSG_WIN, finish_menu, menu_handler);
 	}
       else if (!pair_exists(&g_board))
         {
 	  game_active = 0;
-	  clear_undo_stack();
-	  show_popup(&background, MSG_LOSE, finish_menu, menu_handler);
+	  journal_remove();
+	  show_popup(&background, MSG_LOSE, stuck_menu, menu_handler);
         }
       else
 	{
+	  struct rect r;
+
 	  main_repaint();
-	  FullUpdate();
+
+	  /* removed chips, the new caret and the pair count */
+	  refresh_partial(r1.x, r1.y, r1.w, r1.h);
+	  refresh_partial(r2.x, r2.y, r2.w, r2.h);
+	  cell_rect(g_selectable->positions[caret_pos], &r);
+	  refresh_partial(r.x, r.y, r.w, r.h);
+	  status_rect(&r);
+	  refresh_partial(r.x, r.y, r.w, r.h);
 	}
     }
   else
@@ -509,29 +625,30 @@ static void select_cell(void)
       selection_pos = caret_pos;
       main_repaint();
 
-      cell_rect(&g_selectable->positions[selection_pos], &r);
+      cell_rect(g_selectable->positions[selection_pos], &r);
+      refresh_partial(r.x, r.y, r.w, r.h);
 
       if (prev_selection_pos != -1)
 	{
-	  struct rect r1;
-	  struct rect r2;
-
-	  r1 = r;
-	  cell_rect(&g_selectable->positions[prev_selection_pos], &r2);
-	  union_rect(&r1, &r2, &r);
+	  cell_rect(g_selectable->positions[prev_selection_pos], &r);
+	  refresh_partial(r.x, r.y, r.w, r.h);
 	}
-
-      PartialUpdate(r.x, r.y, r.w, r.h);
     }
 }
 
 static int game_handler(int type, int par1, int par2)
 {
+  if ((type == EVT_KEYPRESS || type == EVT_KEYREPEAT) && navigate(par1))
+    return 1;
+
+  /* anything else sees the caret where the model has it */
+  show_caret();
+
   switch (type)
     {
     case EVT_SHOW:
       main_repaint();
-      FullUpdate();
+      refresh_full();
       break;
     case EVT_KEYPRESS:
       switch (par1)
@@ -540,54 +657,31 @@ static int game_handler(int type, int par1, int par2)
 	  select_cell();
 	  break;
 
-	case KEY_LEFT:
-	  generic_move(move_left);
-	  break;
-
-	case KEY_RIGHT:
-	  generic_move(move_right);
-	  break;
-
-	case KEY_UP:
-	  generic_move(move_up);
-	  break;
-
-	case KEY_DOWN:
-	  generic_move(move_down);
-	  break;
-
 	case KEY_PREV:
 	case KEY_NEXT:
 	case KEY_MENU:
 	  {
-	    static message_id game_menu[] = {
-	      MSG_CONTINUE,
-	      MSG_HINT,
-	      MSG_SEPARATOR,
-	      MSG_NEW_GAME_EASY,
-	      MSG_NEW_GAME_DIFFICULT,
-	      MSG_NEW_GAME_FOUR_BRIDGES,
-	      MSG_SEPARATOR,
-	      MSG_EXIT,
-	      MSG_NONE
-	    };
-
-	    static message_id game_menu_with_undo[] = {
-	      MSG_CONTINUE,
-	      MSG_HINT,
-	      MSG_UNDO,
-	      MSG_SEPARATOR,
-	      MSG_NEW_GAME_EASY,
-	      MSG_NEW_GAME_DIFFICULT,
-	      MSG_NEW_GAME_FOUR_BRIDGES,
-	      MSG_SEPARATOR,
-	      MSG_EXIT,
-	      MSG_NONE
-	    };
-	    if (undo_stack.count != 0)
-	      show_popup(NULL, MSG_NONE, game_menu_with_undo, menu_handler);
-	    else
-	      show_popup(NULL, MSG_NONE, game_menu, menu_handler);
+	    static message_id game_menu[16];
+	    int n = 0;
+
+	    game_menu[n++] = MSG_CONTINUE;
+	    game_menu[n++] = MSG_HINT;
+	    if (g_history.count > 0)
+	      game_menu[n++] = MSG_UNDO;
+	    if (g_history.count < g_history.length)
+	      game_menu[n++] = MSG_REDO;
+	    if (g_history.count > 1)
+	      game_menu[n++] = MSG_UNDO_ALL;
+	    game_menu[n++] = MSG_SEPARATOR;
+	    game_menu[n++] = MSG_NEW_GAME_EASY;
+	    game_menu[n++] = MSG_NEW_GAME_DIFFICULT;
+	    game_menu[n++] = MSG_NEW_GAME_FOUR_BRIDGES;
+	    game_menu[n++] = MSG_SEPARATOR;
+	    game_menu[n++] = MSG_MAIN_MENU;
+	    game_menu[n++] = MSG_EXIT;
+	    game_menu[n++] = MSG_NONE;
+
+	    show_popup(NULL, MSG_NONE, game_menu, menu_handler);
 	    return 1;
 	  }
 	}
@@ -602,7 +696,7 @@ static int game_handler(int type, int par1, int par2)
 	for (i = 0; i < g_selectable->count; ++i)
 	  {
 	    struct rect r;
-	    cell_rect(&g_selectable->positions[i], &r);
+	    cell_rect(g_selectable->positions[i], &r);
 	    if (point_in_rect(rx, ry, &r))
 	      {
 		int prev_caret_pos = caret_pos;
@@ -610,9 +704,9 @@ static int game_handler(int type, int par1, int par2)
 
 		caret_pos = i;
 
-		main_repaint();
-		cell_rect(&g_selectable->positions[prev_caret_pos], &prev_r);
-		PartialUpdate(prev_r.x, prev_r.y, prev_r.w, prev_r.h);
+		/* select_cell() repaints the board */
+		cell_rect(g_selectable->positions[prev_caret_pos], &prev_r);
+		refresh_partial(prev_r.x, prev_r.y, prev_r.w, prev_r.h);
 
 		select_cell();
 		break;
@@ -621,43 +715,32 @@ static int game_handler(int type, int par1, int par2)
       }
       break;
     }
+  refresh_flush();
+  if (type == EVT_SHOW)
+    startup_shown();
   return 0;
 }
 
 static void make_hint(void)
 {
-  int i, j;
+  const hints_t *hints = hints_get(&g_board, g_selectable);
 
-  while (1)
-    {
-      for (i = help_index; i < g_selectable->count - 1; ++i)
-	{
-	  const chip_t chip1 = board_get(&g_board, &g_selectable->positions[i]);
-
-	  for (j = i + 1 + help_offset; j < g_selectable->count; ++j)
-	    {
-	      const chip_t chip2 = board_get(&g_board, &g_selectable->positions[j]);
-
-	      if (fits(chip1, chip2))
-		{
-		  help_index = i;
-		  help_offset = j - i - 1 + 1;
-		  selection_pos = i;
-		  caret_pos = j;
-		  return;
-		}
-	    }
-	  help_offset = 0;
-	}
-      help_index = 0;
-      help_offset = 0;
-    }
+  if (hints->count == 0)
+    return;
+
+  if (hint_cursor >= hints->count)
+    hint_cursor = 0;
+
+  selection_pos = hints->pairs[hint_cursor].first;
+  caret_pos = hints->pairs[hint_cursor].second;
+  ++hint_cursor;
 }
 
 static message_id main_menu_wo_load[] = {
   MSG_NEW_GAME_EASY,
   MSG_NEW_GAME_DIFFICULT,
   MSG_NEW_GAME_FOUR_BRIDGES,
+  MSG_DEALS_ANY,
   MSG_SEPARATOR,
   MSG_TOGGLE_LANGUAGE,
   MSG_CHANGE_ORIENTATION,
@@ -670,6 +753,7 @@ static message_id main_menu_w_load[] = {
   MSG_NEW_GAME_EASY,
   MSG_NEW_GAME_DIFFICULT,
   MSG_NEW_GAME_FOUR_BRIDGES,
+  MSG_DEALS_ANY,
   MSG_SEPARATOR,
   MSG_LOAD,
   MSG_SEPARATOR,
@@ -682,6 +766,41 @@ static message_id main_menu_w_load[] = {
 
 static message_id *main_menu;
 
+static message_id deals_message(void)
+{
+  switch (difficulty)
+    {
+    case DIFFICULTY_EASY:
+      return MSG_DEALS_EASY;
+    case DIFFICULTY_MEDIUM:
+      return MSG_DEALS_MEDIUM;
+    case DIFFICULTY_HARD:
+      return MSG_DEALS_HARD;
+    default:
+      return MSG_DEALS_ANY;
+    }
+}
+
+/* the deals item shows the current difficulty tier */
+static void update_deals_item(message_id *menu)
+{
+  int i;
+  for (i = 0; menu[i] != MSG_NONE; ++i)
+    if (menu[i] >= MSG_DEALS_ANY && menu[i] <= MSG_DEALS_HARD)
+      menu[i] = deals_message();
+}
+
+static void show_main_menu(void)
+{
+  if (!access(JOURNAL_PATH, R_OK) || !access(SAVED_GAME_PATH, R_OK))
+    main_menu = main_menu_w_load;
+  else
+    main_menu = main_menu_wo_load;
+  update_deals_item(main_menu);
+
+  show_popup(&background, MSG_NONE, main_menu, menu_handler);
+}
+
 static void menu_handler(int index)
 {
   switch (index)
@@ -700,6 +819,28 @@ static void menu_handler(int index)
       SetEventHandler(game_handler);
       break;
 
+    case MSG_REDO:
+      redo();
+      SetEventHandler(game_handler);
+      break;
+
+    case MSG_UNDO_ALL:
+      jump_to_move(0);
+      SetEventHandler(game_handler);
+      break;
+
+    case MSG_RESHUFFLE:
+      if (board_reshuffle(&g_board))
+	{
+	  history_start(&g_history, &g_board);
+	  start_game();
+	  save_game();
+	  SetEventHandler(game_handler);
+	}
+      else
+	show_popup(&background, MSG_LOSE, finish_menu, menu_handler);
+      break;
+
     case MSG_NEW_GAME_EASY:
       init_map(&standard_map);
       SetEventHandler(game_handler);
@@ -715,6 +856,10 @@ static void menu_handler(int index)
       SetEventHandler(game_handler);
       break;
 
+    case MSG_MAIN_MENU:
+      show_main_menu();
+      break;
+
     case MSG_LOAD:
       if (load_game())
 	{
@@ -723,6 +868,15 @@ static void menu_handler(int index)
 	}
       break;
 
+    case MSG_DEALS_ANY:
+    case MSG_DEALS_EASY:
+    case MSG_DEALS_MEDIUM:
+    case MSG_DEALS_HARD:
+      difficulty = (difficulty + 1) % (DIFFICULTY_HARD + 1);
+      update_deals_item(main_menu);
+      show_popup(&background, MSG_NONE, main_menu, menu_handler);
+      break;
+
     case MSG_TOGGLE_LANGUAGE:
       if (current_language == ENGLISH)
 	current_language = RUSSIAN;
@@ -737,16 +891,13 @@ static void menu_handler(int index)
       else
         orientation = ROTATE270;
       SetOrientation(orientation);
-      ClearScreen();
-      StretchBitmap(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, (ibitmap*)&background, 0);
-      FullUpdate();
+      draw_background(&background);
+      refresh_full();
       show_popup(&background, MSG_NONE, main_menu, menu_handler);
       break;
 
     case MSG_EXIT:
       write_state();
-      if (game_active)
-	save_game();
       CloseApp();
       break;
     }
@@ -757,71 +908,125 @@ static int main_handler(int type, int par1, int par2)
   switch (type)
     {
     case EVT_INIT:
+      startup_mark("start");
       srand(time(NULL));
-      bitmaps_init();
       read_state();
+      startup_mark("config");
+      startup_set_log(startup_log ? STARTUP_LOG_PATH : NULL);
       SetOrientation(orientation);
-      if (!access(SAVED_GAME_PATH, R_OK))
-	main_menu = main_menu_w_load;
+      startup_mark("orientation");
+
+      /* a game in progress comes back as the first frame, without the menu */
+      if (load_game())
+	{
+	  startup_mark("load");
+	  start_game();
+	  SetEventHandler(game_handler);
+	}
+      else if (start_map != NULL)
+	{
+	  init_map(start_map);
+	  startup_mark("new game");
+	  SetEventHandler(game_handler);
+	}
       else
-	main_menu = main_menu_wo_load;
-      
-      show_popup(&background, MSG_NONE, main_menu, menu_handler);
+	show_main_menu();
+      startup_mark("init");
       break;
     case EVT_EXIT:
+      /* rewrites the journal compacted, redo tail included */
       if (game_active)
 	save_game();
+      TRACE_DUMP(TRACE_PATH);
       break;
     }
   return 0;
 }
 
-static void read_state(void)
-{
-  FILE *f = fopen(STATEPATH "/pb-mahjong", "r");
-  if (!f)
-    return;
-
-  regex_t reg;
-  regcomp(&reg, "^([a-z]+)([ \t]*)=([ \t]*)([^ \t\r\n]+)", REG_EXTENDED);
+static const struct {
+  const char *name;
+  map_t *map;
+} start_maps[] = {
+  { "menu", NULL },
+  { "easy", &standard_map },
+  { "difficult", &difficult_map },
+  { "four-bridges", &four_bridges_map },
+};
 
-  char line[128];
-  regmatch_t pmatch[16];
+static void read_setting(const char *key, const char *value)
+{
+  int i;
 
-  while (fgets(line, sizeof(line), f))
+  if (!strcmp(key, "language"))
     {
-      if (regexec(&reg, line, 16, pmatch, 0))
-	continue;
-
-      const char *key = &line[pmatch[1].rm_so];
-      line[pmatch[1].rm_eo] = '\0';
-
-      const char *value = &line[pmatch[4].rm_so];
-      line[pmatch[4].rm_eo] = '\0';
-
-      if (!strcmp(key, "language"))
-	{
-	  if (!strcmp(value, "en"))
-	    current_language = ENGLISH;
-	  else if (!strcmp(value, "ru"))
-	    current_language = RUSSIAN;
-	}
-      else if (!strcmp(key, "orientation"))
-	{
-	  if (!strcmp(value, "90"))
-	    orientation = ROTATE90;
-	  else if (!strcmp(value, "270"))
-	    orientation = ROTATE270;
-	}
+      if (!strcmp(value, "en"))
+	current_language = ENGLISH;
+      else if (!strcmp(value, "ru"))
+	current_language = RUSSIAN;
     }
-  fclose(f);
+  else if (!strcmp(key, "orientation"))
+    {
+      if (!strcmp(value, "90"))
+	orientation = ROTATE90;
+      else if (!strcmp(value, "270"))
+	orientation = ROTATE270;
+    }
+  else if (!strcmp(key, "deals"))
+    {
+      if (!strcmp(value, "any"))
+	difficulty = DIFFICULTY_ANY;
+      else if (!strcmp(value, "easy"))
+	difficulty = DIFFICULTY_EASY;
+      else if (!strcmp(value, "medium"))
+	difficulty = DIFFICULTY_MEDIUM;
+      else if (!strcmp(value, "hard"))
+	difficulty = DIFFICULTY_HARD;
+    }
+  else if (!strcmp(key, "refresh"))
+    refresh_budget = config_int(value, 1, 254, refresh_budget);
+  else if (!strcmp(key, "map"))
+    {
+      for (i = 0; i < sizeof(start_maps) / sizeof(start_maps[0]); ++i)
+	if (!strcmp(value, start_maps[i].name))
+	  start_map = start_maps[i].map;
+    }
+  else if (!strcmp(key, "hints"))
+    {
+      if (!strcmp(value, "background"))
+	background_hints = 1;
+      else if (!strcmp(value, "demand"))
+	background_hints = 0;
+    }
+  else if (!strcmp(key, "menu-cache"))
+    menu_cache_size = config_int(value, 1, MENU_LAYOUT_CACHE_MAX, menu_cache_size);
+  else if (!strcmp(key, "board-cache"))
+    {
+      if (!strcmp(value, "on"))
+	board_cache = 1;
+      else if (!strcmp(value, "off"))
+	board_cache = 0;
+    }
+  else if (!strcmp(key, "startup-log"))
+    {
+      if (!strcmp(value, "on"))
+	startup_log = 1;
+      else if (!strcmp(value, "off"))
+	startup_log = 0;
+    }
+}
 
-  regfree(&reg);
+static void read_state(void)
+{
+  config_read(STATE_PATH, read_setting);
+
+  refresh_set_budget(refresh_budget);
+  menu_set_cache_size(menu_cache_size);
 }
 
 static void write_state(void)
 {
-  FILE *f = fopen(STATEPATH "/pb-mahjong", "w");
+  int i;
+  FILE *f = fopen(STATE_PATH, "w");
   if (!f)
     return;
 
@@ -835,84 +1040,112 @@ static void write_state(void)
   else if (orientation == ROTATE270)
     fprintf(f, "orientation = 270\n");
 
+  if (difficulty == DIFFICULTY_ANY)
+    fprintf(f, "deals = any\n");
+  else if (difficulty == DIFFICULTY_EASY)
+    fprintf(f, "deals = easy\n");
+  else if (difficulty == DIFFICULTY_MEDIUM)
+    fprintf(f, "deals = medium\n");
+  else if (difficulty == DIFFICULTY_HARD)
+    fprintf(f, "deals = hard\n");
+
+  fprintf(f, "refresh = %d\n", refresh_budget);
+  for (i = 0; i < sizeof(start_maps) / sizeof(start_maps[0]); ++i)
+    if (start_maps[i].map == start_map)
+      fprintf(f, "map = %s\n", start_maps[i].name);
+  fprintf(f, "hints = %s\n", background_hints ? "background" : "demand");
+  fprintf(f, "menu-cache = %d\n", menu_cache_size);
+  fprintf(f, "board-cache = %s\n", board_cache ? "on" : "off");
+  fprintf(f, "startup-log = %s\n", startup_log ? "on" : "off");
+
   fclose(f);
 }
 
-static int load_game(void)
+static int load_legacy_game(void)
 {
+  /* parsed aside, the game in memory only changes once all of it checks out */
+  static board_t loaded;
+  static history_t replayed;
   int i, j, k;
+  int rows, cols;
+  int count;
+  position_t positions[144];
+  chip_t chips[144];
+  unsigned long long hash;
 
   FILE *f = fopen(SAVED_GAME_PATH, "r");
   if (!f)
     return 0;
 
-  fscanf(f, "%d %d\n", &row_count, &col_count);
+  if (fscanf(f, "%d %d\n", &rows, &cols) != 2 ||
+      rows <= 0 || rows > MAX_ROW_COUNT || cols <= 0 || cols > MAX_COL_COUNT)
+    goto fail;
 
+  board_clear(&loaded);
   for (i = 0; i < MAX_ROW_COUNT; ++i)
     for (j = 0; j < MAX_COL_COUNT; ++j)
       for (k = 0; k < MAX_HEIGHT; ++k)
 	{
 	  int ch;
-	  position_t pos;
-	  pos.y = i;
-	  pos.x = j;
-	  pos.k = k;
 
-	  fscanf(f, "%d\n", &ch);
+	  if (fscanf(f, "%d\n", &ch) != 1 || ch < 0 || ch > 0xFF)
+	    goto fail;
 
-	  board_set(&g_board, &pos, ch);
+	  board_set(&loaded, position_make(i, j, k), ch);
 	}
 
-  fscanf(f, "%d\n", &undo_stack.count);
-  for (i = 0; i < undo_stack.count; ++i)
+  /* undo entries are stored as removed chips, two per move */
+  if (fscanf(f, "%d\n", &count) != 1 || count < 0 || count > 144)
+    goto fail;
+  for (i = 0; i < count; ++i)
     {
-      int chip;
-      fscanf(f, "%d %d %d %d\n",
-	     &undo_stack.positions[i].y,
-	     &undo_stack.positions[i].x,
-	     &undo_stack.positions[i].k,
-	     &chip);
-      undo_stack.chips[i] = chip;
+      int y, x, z, chip;
+      if (fscanf(f, "%d %d %d %d\n", &y, &x, &z, &chip) != 4 ||
+	  y < 0 || y >= MAX_ROW_COUNT || x < 0 || x >= MAX_COL_COUNT || z < 0 || z >= MAX_HEIGHT)
+	goto fail;
+      positions[i] = position_make(y, x, z);
+      chips[i] = chip;
     }
 
+  /* saves written before position hashes were introduced end here */
+  if (fscanf(f, "%llx\n", &hash) == 1 && hash != board_hash(&loaded))
+    goto fail;
+
   fclose(f);
 
-  return 1;
-}
+  /* replay the moves to rebuild their undo frames */
+  for (i = count - 1; i >= 0; --i)
+    board_set(&loaded, positions[i], chips[i]);
 
-static void save_game(void)
-{
-  int i, j, k;
+  history_start(&replayed, &loaded);
+  for (i = 0; i + 1 < count; i += 2)
+    if (!history_do(&replayed, &loaded, positions[i], positions[i + 1]))
+      return 0;
 
-  FILE *f = fopen(SAVED_GAME_PATH, "w");
-  if (!f)
-    return;
+  g_board = loaded;
+  g_history = replayed;
+  row_count = rows;
+  col_count = cols;
+  return 1;
 
-  fprintf(f, "%d %d\n", row_count, col_count);
+ fail:
+  fclose(f);
+  return 0;
+}
 
-  for (i = 0; i < MAX_ROW_COUNT; ++i)
-    for (j = 0; j < MAX_COL_COUNT; ++j)
-      for (k = 0; k < MAX_HEIGHT; ++k)
-	{
-	  chip_t ch;
-	  position_t pos;
-	  pos.y = i;
-	  pos.x = j;
-	  pos.k = k;
-	  ch = board_get(&g_board, &pos);
-
-	  fprintf(f, "%d\n", ch);
-	}
+static int load_game(void)
+{
+  TRACE_SCOPE("load_game");
+  if (journal_load(JOURNAL_PATH, &g_board, &row_count, &col_count, &g_history))
+    return 1;
 
-  fprintf(f, "%d\n", undo_stack.count);
-  for (i = 0; i < undo_stack.count; ++i)
-    fprintf(f, "%d %d %d %d\n",
-	    undo_stack.positions[i].y,
-	    undo_stack.positions[i].x,
-	    undo_stack.positions[i].k,
-	    undo_stack.chips[i]);
+  if (!load_legacy_game())
+    return 0;
 
-  fclose(f);
+  /* carried over to the journal */
+  save_game();
+  unlink(SAVED_GAME_PATH);
+  return 1;
 }
 
 int main(int argc, char **argv)
@@ -1,12 +1,29 @@
+#include <string.h>
 #include "menu.h"
 
+#include "common.h"
 #include "geometry.h"
+#include "refresh.h"
+#include "layer.h"
+#include "startup.h"
 
 #define MENU_FONT_NAME (DEFAULTFONT)
 #define MENU_FONT_SIZE (18)
 #define MENU_MARGIN (10)
 #define MENU_ITEM_HEIGHT (30)
 #define MENU_SEPARATOR_HEIGHT (5)
+#define MENU_MAX_ITEMS (16)
+#define BANNER_FONT_SIZE (40)
+
+/* measured rows of a menu, depends only on the items and the language */
+typedef struct {
+  message_id items[MENU_MAX_ITEMS];
+  int count;
+  language_t language;
+  int width;
+  int height;
+  int row_y[MENU_MAX_ITEMS];
+} menu_layout_t;
 
 typedef struct {
   const ibitmap *background;
@@ -18,9 +35,15 @@ typedef struct {
   int current;
 
   int calc_required;
+  const menu_layout_t *layout;
   struct rect bounds;
 } menu_t;
 
+static menu_layout_t g_layouts[MENU_LAYOUT_CACHE_MAX];
+static int g_layout_size = MENU_LAYOUT_CACHE_SIZE;
+static int g_layout_count = 0;
+static int g_layout_next = 0;
+
 static ifont *g_menu_font = NULL;
 static ifont *get_menu_font(void)
 {
@@ -29,39 +52,133 @@ static ifont *get_menu_font(void)
   return g_menu_font;
 }
 
-void menu_calc(menu_t *menu)
+static ifont *g_banner_font = NULL;
+static ifont *get_banner_font(void)
 {
-  if (!menu->calc_required)
-    return;
-  menu->calc_required = 1;
+  if (g_banner_font == NULL)
+    g_banner_font = OpenFont(MENU_FONT_NAME, BANNER_FONT_SIZE, 1);
+  return g_banner_font;
+}
 
-  SetFont(get_menu_font(), BLACK);
+/* the last background scaled to the screen, rescaled when the screen size changes */
+static layer_t g_background;
+static const ibitmap *g_background_source = NULL;
+
+void draw_background(const ibitmap *background)
+{
+  const int width = ScreenWidth();
+  const int height = ScreenHeight();
+
+  if (g_background_source != background || !layer_fits(&g_background, width, height))
+    {
+      g_background_source = NULL;
+      if (!layer_resize(&g_background, width, height))
+	{
+	  StretchBitmap(0, 0, width, height, (ibitmap*)background, 0);
+	  return;
+	}
+
+      layer_begin(&g_background, 0, 0, width, height);
+      StretchBitmap(0, 0, width, height, (ibitmap*)background, 0);
+      layer_end(&g_background);
+      g_background_source = background;
+    }
+
+  layer_draw(&g_background, 0, 0);
+}
 
+void menu_set_cache_size(int size)
+{
+  g_layout_size = min_int(max_int(size, 1), MENU_LAYOUT_CACHE_MAX);
+  g_layout_count = 0;
+  g_layout_next = 0;
+}
+
+static const menu_layout_t *get_layout(const message_id *items, int count)
+{
+  menu_layout_t *layout;
   int i;
-  menu->bounds.w = 0;
-  menu->bounds.h = 0;
-  for (i = 0; i < menu->count; ++i)
+
+  for (i = 0; i < g_layout_count; ++i)
     {
-      if (menu->items[i] > MSG_NONE)
+      layout = &g_layouts[i];
+      if (layout->count == count &&
+	  layout->language == current_language &&
+	  !memcmp(layout->items, items, count * sizeof(message_id)))
+	return layout;
+    }
+
+  layout = &g_layouts[g_layout_next];
+  g_layout_next = (g_layout_next + 1) % g_layout_size;
+  if (g_layout_count < g_layout_size)
+    ++g_layout_count;
+
+  memcpy(layout->items, items, count * sizeof(message_id));
+  layout->count = count;
+  layout->language = current_language;
+
+  SetFont(get_menu_font(), BLACK);
+
+  layout->width = 0;
+  layout->height = 0;
+  for (i = 0; i < count; ++i)
+    {
+      layout->row_y[i] = layout->height;
+      if (items[i] > MSG_NONE)
 	{
-	  const int lw = StringWidth((char*)get_message(menu->items[i]));
-	  if (lw > menu->bounds.w)
-	    menu->bounds.w = lw;
-	  menu->bounds.h += MENU_ITEM_HEIGHT;
+	  const int lw = StringWidth((char*)get_message(items[i]));
+	  if (lw > layout->width)
+	    layout->width = lw;
+	  layout->height += MENU_ITEM_HEIGHT;
 	}
       else /*separator*/
 	{
-	  menu->bounds.h += MENU_SEPARATOR_HEIGHT;
+	  layout->height += MENU_SEPARATOR_HEIGHT;
 	}
     }
+  return layout;
+}
+
+void menu_calc(menu_t *menu)
+{
+  if (!menu->calc_required)
+    return;
+  menu->calc_required = 0;
 
+  menu->layout = get_layout(menu->items, menu->count);
+  menu->bounds.w = menu->layout->width;
+  menu->bounds.h = menu->layout->height;
   menu->bounds.x = (ScreenWidth() - menu->bounds.w - 2 * MENU_MARGIN) / 2 + MENU_MARGIN;
   menu->bounds.y = ScreenHeight() - menu->bounds.h - MENU_MARGIN - 30;
 }
 
+static void item_rect(const menu_t *menu, int i, struct rect *r)
+{
+  r->x = menu->bounds.x - 5;
+  r->y = menu->bounds.y + menu->layout->row_y[i];
+  r->w = menu->bounds.w + 10;
+  r->h = MENU_ITEM_HEIGHT;
+}
+
+static void draw_item(const menu_t *menu, int i)
+{
+  struct rect r;
+  item_rect(menu, i, &r);
+
+  DrawTextRect(menu->bounds.x,
+	       r.y,
+	       menu->bounds.w,
+	       MENU_ITEM_HEIGHT,
+	       (char*)get_message(menu->items[i]),
+	       ALIGN_LEFT | VALIGN_MIDDLE);
+
+  if (i == menu->current)
+    DrawSelection(r.x, r.y, r.w, r.h, DGRAY);
+}
+
 static void draw_popup(menu_t *menu)
 {
-  int i, y;
+  int i;
 
   menu_calc(menu);
 
@@ -78,38 +195,49 @@ static void draw_popup(menu_t *menu)
 	   menu->bounds.h + 2 * MENU_MARGIN,
 	   BLACK);
 
-  y = menu->bounds.y;
   for (i = 0; i < menu->count; ++i)
     {
       if (menu->items[i] > MSG_NONE)
-	{
-	  DrawTextRect(menu->bounds.x,
-		       y,
-		       menu->bounds.w,
-		       MENU_ITEM_HEIGHT,
-		       (char*)get_message(menu->items[i]),
-		       ALIGN_LEFT | VALIGN_MIDDLE);
-
-	  if (i == menu->current)
-	    DrawSelection(menu->bounds.x - 5, y, menu->bounds.w + 10, MENU_ITEM_HEIGHT, DGRAY);
-
-	  y += MENU_ITEM_HEIGHT;
-	}
+	draw_item(menu, i);
       else /*separator*/
 	{
-	  const int sy = y + MENU_SEPARATOR_HEIGHT / 2;
+	  const int sy = menu->bounds.y + menu->layout->row_y[i] + MENU_SEPARATOR_HEIGHT / 2;
 	  DrawLine(menu->bounds.x, sy, menu->bounds.x + menu->bounds.w, sy, BLACK);
-	  y += MENU_SEPARATOR_HEIGHT;
 	}
     }
 }
 
+/* moves the selection redrawing just the two rows */
+static void set_current(menu_t *menu, int current)
+{
+  const int prev = menu->current;
+  struct rect r;
+
+  if (current == prev)
+    return;
+
+  menu_calc(menu);
+  menu->current = current;
+
+  SetFont(get_menu_font(), BLACK);
+
+  item_rect(menu, prev, &r);
+  FillArea(r.x, r.y, r.w, r.h, WHITE);
+  draw_item(menu, prev);
+  refresh_partial(r.x, r.y, r.w, r.h);
+
+  item_rect(menu, current, &r);
+  FillArea(r.x, r.y, r.w, r.h, WHITE);
+  draw_item(menu, current);
+  refresh_partial(r.x, r.y, r.w, r.h);
+}
+
 static void menu_update(menu_t *menu)
 {
-  PartialUpdate(menu->bounds.x - MENU_MARGIN,
-		menu->bounds.y - MENU_MARGIN,
-		menu->bounds.w + 2 * MENU_MARGIN,
-		menu->bounds.h + 2 * MENU_MARGIN);
+  refresh_partial(menu->bounds.x - MENU_MARGIN,
+		  menu->bounds.y - MENU_MARGIN,
+		  menu->bounds.w + 2 * MENU_MARGIN,
+		  menu->bounds.h + 2 * MENU_MARGIN);
 }
 
 static menu_t g_menu1;
@@ -121,10 +249,10 @@ static int menu_handler(int type, int par1, int par2)
   switch (type)
     {
     case EVT_SHOW:
-      if (menu->background != NULL || menu->message != MSG_NONE)
-	ClearScreen();
       if (menu->background != NULL)
-	StretchBitmap(0, 0, ScreenWidth(), ScreenHeight(), (ibitmap*)menu->background, 0);
+	draw_background(menu->background);
+      else if (menu->message != MSG_NONE)
+	ClearScreen();
       if (menu->message != MSG_NONE)
 	{
 	  const int x_margin = 100;
@@ -133,15 +261,12 @@ static int menu_handler(int type, int par1, int par2)
 	  FillArea(x_margin, y_margin, ScreenWidth() - 2 * x_margin, height, WHITE);
 	  DrawSelection(x_margin, y_margin, ScreenWidth() - 2 * x_margin, height, DGRAY);
 
-	  ifont *font = OpenFont(MENU_FONT_NAME, 40, 1);
-	  SetFont(font, BLACK);
+	  SetFont(get_banner_font(), BLACK);
 	  DrawTextRect(x_margin, y_margin, ScreenWidth() - 2 * x_margin, height, (char*)get_message(menu->message), ALIGN_CENTER | VALIGN_MIDDLE);
-
-	  CloseFont(font);
 	}
       draw_popup(menu);
       if (menu->background != NULL || menu->message != MSG_NONE)
-	FullUpdate();
+	refresh_full();
       else
 	menu_update(menu);
       break;
@@ -149,24 +274,28 @@ static int menu_handler(int type, int par1, int par2)
       switch (par1)
 	{
 	case KEY_UP:
-	  do
-	    {
-	      menu->current = (menu->current + menu->count - 1) % menu->count;
-	    }
-	  while (menu->items[menu->current] <= MSG_NONE);
-
-	  draw_popup(menu);
-	  menu_update(menu);
+	  {
+	    int current = menu->current;
+	    do
+	      {
+		current = (current + menu->count - 1) % menu->count;
+	      }
+	    while (menu->items[current] <= MSG_NONE);
+
+	    set_current(menu, current);
+	  }
 	  break;
 	case KEY_DOWN:
-	  do
-	    {
-	      menu->current = (menu->current + 1) % menu->count;
-	    }
-	  while (menu->items[menu->current] <= MSG_NONE);
-
-	  draw_popup(menu);
-	  menu_update(menu);
+	  {
+	    int current = menu->current;
+	    do
+	      {
+		current = (current + 1) % menu->count;
+	      }
+	    while (menu->items[current] <= MSG_NONE);
+
+	    set_current(menu, current);
+	  }
 	  break;
 	case KEY_OK:
 	  menu->proc(menu->items[menu->current]);
@@ -182,34 +311,23 @@ static int menu_handler(int type, int par1, int par2)
 
 	if (point_in_rect(rx, ry, &menu->bounds))
 	  {
-	    int y = menu->bounds.y;
+	    const int y = ry - menu->bounds.y;
 	    int i;
 	    for (i = 0; i < menu->count; ++i)
-	      {
-		if (menu->items[i] > MSG_NONE)
-		  {
-		    if (ry >= y && ry < y + MENU_ITEM_HEIGHT)
-		      {
-			menu->current = i;
-			draw_popup(menu);
-			menu_update(menu);
-			menu->proc(menu->items[menu->current]);
-			goto done;
-		      }
-
-		    y += MENU_ITEM_HEIGHT;
-		  }
-		else /*separator*/
-		  {
-		    y += MENU_SEPARATOR_HEIGHT;
-		  }
-	      }
+	      if (menu->items[i] > MSG_NONE &&
+		  y >= menu->layout->row_y[i] && y < menu->layout->row_y[i] + MENU_ITEM_HEIGHT)
+		{
+		  set_current(menu, i);
+		  menu->proc(menu->items[menu->current]);
+		  break;
+		}
 	  }
-      done:
-	;
       }
       break;
     }
+  refresh_flush();
+  if (type == EVT_SHOW)
+    startup_shown();
   return 0;
 }
 
@@ -222,7 +340,7 @@ void show_popup(const ibitmap* background, message_id message, message_id *items
   menu->message = message;
   menu->items = items;
   menu->count = 0;
-  while (items[menu->count] != MSG_NONE)
+  while (items[menu->count] != MSG_NONE && menu->count < MENU_MAX_ITEMS)
     ++menu->count;
   menu->proc = hproc;
   menu->current = 0;
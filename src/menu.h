@@ -4,6 +4,14 @@
 #include "inkview.h"
 #include "messages.h"
 
+/* draws background stretched over the screen */
+extern void draw_background(const ibitmap *background);
+
+/* menus whose measured layout is kept, set before the first menu is shown */
+#define MENU_LAYOUT_CACHE_SIZE (4)
+#define MENU_LAYOUT_CACHE_MAX (8)
+extern void menu_set_cache_size(int size);
+
 extern void show_popup(const ibitmap* background, message_id message, message_id *menu, iv_menuhandler hproc);
 
 #endif
@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include <string.h>
+#include "nav.h"
+
+static int row_of(position_t pos)
+{
+  return (position_y(pos) - 1) / 2;
+}
+
+/* reading order: row, column, then y within the row; k plays no part */
+static int key_of(int row, int x, int y)
+{
+  return (row << 10) | (x << 5) | y;
+}
+
+static int pos_key(position_t pos)
+{
+  return key_of(row_of(pos), position_x(pos), position_y(pos));
+}
+
+/* index of the first position whose key is not less than key */
+static int lower_bound(const positions_t *list, int key)
+{
+  int lo = 0;
+  int hi = list->count;
+
+  while (lo < hi)
+    {
+      const int mid = (lo + hi) / 2;
+      if (pos_key(list->positions[mid]) < key)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo;
+}
+
+/* index of the chip of row nearest to x other than exclude, or -1 */
+static int nearest_in_row(const nav_t *nav, int row, int x, int exclude)
+{
+  int lo = nav->row_start[row];
+  int hi = nav->row_start[row + 1];
+  const int end = hi;
+  int best = -1;
+  int i;
+
+  while (lo < hi)
+    {
+      const int mid = (lo + hi) / 2;
+      if (position_x(nav->list.positions[mid]) < x)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  /* the nearest chips are around lo, the one on the left wins a tie */
+  for (i = lo - 2; i <= lo + 1; ++i)
+    if (i >= nav->row_start[row] && i < end && i != exclude)
+      {
+	if (best < 0 || abs(position_x(nav->list.positions[i]) - x) < abs(position_x(nav->list.positions[best]) - x))
+	  best = i;
+      }
+  return best;
+}
+
+/* nearest chip in the nearest non-empty row in direction dir, wrapping around */
+static int vertical_neighbour(const nav_t *nav, int i, int dir)
+{
+  const position_t pos = nav->list.positions[i];
+  const int row = row_of(pos);
+  int n;
+
+  for (n = 1; n <= NAV_ROW_COUNT; ++n)
+    {
+      const int r = (row + dir * n + NAV_ROW_COUNT) % NAV_ROW_COUNT;
+      const int found = nearest_in_row(nav, r, position_x(pos), i);
+      if (found >= 0)
+	return found;
+    }
+  return i;
+}
+
+static void link(nav_t *nav)
+{
+  int i, r;
+  const int count = nav->list.count;
+
+  for (r = 0; r <= NAV_ROW_COUNT; ++r)
+    nav->row_start[r] = lower_bound(&nav->list, key_of(r, 0, 0));
+
+  for (i = 0; i < count; ++i)
+    {
+      nav->left[i] = i > 0 ? i - 1 : count - 1;
+      nav->right[i] = i < count - 1 ? i + 1 : 0;
+      nav->up[i] = vertical_neighbour(nav, i, -1);
+      nav->down[i] = vertical_neighbour(nav, i, 1);
+    }
+}
+
+void nav_build(nav_t *nav, const board_t *board)
+{
+  int i, j;
+
+  nav->list.count = 0;
+  for (i = 0; i < MAX_ROW_COUNT; ++i)
+    for (j = 0; j < MAX_COL_COUNT; ++j)
+      if (board->selectable[i][j])
+	{
+	  const position_t pos = position_make(i, j, board->selectable[i][j] - 1);
+	  const int n = lower_bound(&nav->list, pos_key(pos));
+
+	  memmove(&nav->list.positions[n + 1], &nav->list.positions[n], (nav->list.count - n) * sizeof(position_t));
+	  nav->list.positions[n] = pos;
+	  ++nav->list.count;
+	}
+
+  link(nav);
+}
+
+void nav_update(nav_t *nav, const board_t *board, const move_t *move)
+{
+  int i;
+  positions_t *list = &nav->list;
+
+  for (i = 0; i < move->delta_count; ++i)
+    {
+      const int y = move->delta[i].y;
+      const int x = move->delta[i].x;
+      const int key = key_of((y - 1) / 2, x, y);
+
+      /* the list holds at most one chip per column */
+      const int n = lower_bound(list, key);
+      if (n < list->count && pos_key(list->positions[n]) == key)
+	{
+	  memmove(&list->positions[n], &list->positions[n + 1], (list->count - n - 1) * sizeof(position_t));
+	  --list->count;
+	}
+
+      if (board->selectable[y][x])
+	{
+	  memmove(&list->positions[n + 1], &list->positions[n], (list->count - n) * sizeof(position_t));
+	  list->positions[n] = position_make(y, x, board->selectable[y][x] - 1);
+	  ++list->count;
+	}
+    }
+
+  link(nav);
+}
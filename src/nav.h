@@ -0,0 +1,29 @@
+#ifndef NAV_H
+#define NAV_H
+
+#include "board.h"
+
+/* rows of chips as seen by the player, (y - 1) / 2 */
+#define NAV_ROW_COUNT (MAX_ROW_COUNT / 2 + 1)
+
+/*
+  Selectable chips in reading order (rows, then columns) with the caret
+  neighbours of each of them.  Left and right wrap around the list, up
+  and down go to the nearest chip of the nearest row in that direction,
+  wrapping around the board.
+*/
+typedef struct {
+  positions_t list;
+  short up[144];
+  short down[144];
+  short left[144];
+  short right[144];
+  short row_start[NAV_ROW_COUNT + 1];
+} nav_t;
+
+void nav_build(nav_t *nav, const board_t *board);
+
+/* patches the list after board_remove_pair() or board_restore_pair() of move */
+void nav_update(nav_t *nav, const board_t *board, const move_t *move);
+
+#endif
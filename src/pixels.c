@@ -0,0 +1,263 @@
+#include <string.h>
+#include "inkview.h"
+
+#include "common.h"
+#include "pixels.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PIXELS_SSE2 1
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PIXELS_NEON 1
+#endif
+
+/* widest span pixels_stretch4() handles; wider images are clipped */
+#define PIXELS_MAX_WIDTH (2048)
+
+static icanvas *usable_canvas(void)
+{
+  icanvas *c = GetCanvas();
+  return c != NULL && c->depth == 8 ? c : NULL;
+}
+
+/* clips a rect to the canvas clip rect, returns 0 if nothing is left */
+static int clip_rect(const icanvas *c, int *x, int *y, int *w, int *h)
+{
+  const int x2 = min_int(*x + *w, c->clipx2 + 1);
+  const int y2 = min_int(*y + *h, c->clipy2 + 1);
+
+  *x = max_int(*x, c->clipx1);
+  *y = max_int(*y, c->clipy1);
+  *w = x2 - *x;
+  *h = y2 - *y;
+  return *w > 0 && *h > 0;
+}
+
+/* 4-bit gray to 8-bit, n packed bytes into 2 * n pixels */
+static void unpack4(unsigned char *dst, const unsigned char *src, int n)
+{
+  int i = 0;
+
+#if defined(PIXELS_SSE2)
+  const __m128i mask = _mm_set1_epi8(0x0F);
+  for (; i + 16 <= n; i += 16)
+    {
+      const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+      const __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+      const __m128i lo = _mm_and_si128(v, mask);
+      __m128i a = _mm_unpacklo_epi8(hi, lo);
+      __m128i b = _mm_unpackhi_epi8(hi, lo);
+      a = _mm_or_si128(a, _mm_slli_epi16(a, 4));
+      b = _mm_or_si128(b, _mm_slli_epi16(b, 4));
+      _mm_storeu_si128((__m128i*)(dst + 2 * i), a);
+      _mm_storeu_si128((__m128i*)(dst + 2 * i + 16), b);
+    }
+#elif defined(PIXELS_NEON)
+  for (; i + 16 <= n; i += 16)
+    {
+      const uint8x16_t v = vld1q_u8(src + i);
+      uint8x16x2_t p;
+      p.val[0] = vshrq_n_u8(v, 4);
+      p.val[1] = vandq_u8(v, vdupq_n_u8(0x0F));
+      p.val[0] = vorrq_u8(p.val[0], vshlq_n_u8(p.val[0], 4));
+      p.val[1] = vorrq_u8(p.val[1], vshlq_n_u8(p.val[1], 4));
+      vst2q_u8(dst + 2 * i, p);
+    }
+#endif
+
+  for (; i < n; ++i)
+    {
+      dst[2 * i] = (src[i] >> 4) * 0x11;
+      dst[2 * i + 1] = (src[i] & 0x0F) * 0x11;
+    }
+}
+
+static void invert_span(unsigned char *p, int n)
+{
+  int i = 0;
+
+#if defined(PIXELS_SSE2)
+  const __m128i ones = _mm_set1_epi8((char)0xFF);
+  for (; i + 16 <= n; i += 16)
+    {
+      const __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+      _mm_storeu_si128((__m128i*)(p + i), _mm_xor_si128(v, ones));
+    }
+#elif defined(PIXELS_NEON)
+  for (; i + 16 <= n; i += 16)
+    vst1q_u8(p + i, vmvnq_u8(vld1q_u8(p + i)));
+#endif
+
+  for (; i < n; ++i)
+    p[i] ^= 0xFF;
+}
+
+/* spans clamped to the clip rect */
+static inline void hspan(const icanvas *c, int x, int y, int n, int v)
+{
+  int x2 = min_int(x + n, c->clipx2 + 1);
+
+  if (y < c->clipy1 || y > c->clipy2)
+    return;
+  x = max_int(x, c->clipx1);
+  if (x < x2)
+    memset(c->addr + y * c->scanline + x, v, x2 - x);
+}
+
+static inline void vspan(const icanvas *c, int x, int y, int n, int v)
+{
+  const int y2 = min_int(y + n, c->clipy2 + 1);
+  unsigned char *p;
+
+  if (x < c->clipx1 || x > c->clipx2)
+    return;
+  y = max_int(y, c->clipy1);
+  for (p = c->addr + y * c->scanline + x; y < y2; ++y, p += c->scanline)
+    *p = v;
+}
+
+static inline void outline(const icanvas *c, int x, int y, int w, int h, int v)
+{
+  if (w <= 0 || h <= 0)
+    return;
+  hspan(c, x, y, w, v);
+  hspan(c, x, y + h - 1, w, v);
+  vspan(c, x, y, h, v);
+  vspan(c, x + w - 1, y, h, v);
+}
+
+/* 45 degree line down and to the right */
+static inline void diagonal(const icanvas *c, int x, int y, int n, int v)
+{
+  int i;
+  for (i = 0; i < n; ++i, ++x, ++y)
+    if (x >= c->clipx1 && x <= c->clipx2 && y >= c->clipy1 && y <= c->clipy2)
+      c->addr[y * c->scanline + x] = v;
+}
+
+void pixels_frame(int x, int y, int w, int h, int thickness, int color)
+{
+  icanvas *c = usable_canvas();
+  int i;
+
+  for (i = 0; i < thickness; ++i)
+    if (c != NULL)
+      outline(c, x + i, y + i, w - 2 * i, h - 2 * i, color & 0xFF);
+    else
+      DrawRect(x + i, y + i, w - 2 * i, h - 2 * i, color);
+}
+
+void pixels_tile(int x, int y, int w, int h, int depth, int light, int dark)
+{
+  icanvas *c = usable_canvas();
+  const int d = depth;
+  int i;
+
+  if (c == NULL)
+    {
+      DrawRect(x - d, y - d, w, h, dark);
+      for (i = 1; i < d; ++i)
+	{
+	  DrawLine(x - i, y - i, x - i, y - i + h - 1, light);
+	  DrawLine(x - i, y - i, x - i + w - 1, y - i, light);
+	}
+      DrawLine(x - d, y - d, x, y, dark);
+      DrawLine(x - d + w - 1, y - d, x + w - 1, y, dark);
+      DrawLine(x - d, y - d + h - 1, x, y + h - 1, dark);
+      FillArea(x, y, w, h, WHITE);
+      DrawRect(x, y, w, h, dark);
+      return;
+    }
+
+  light &= 0xFF;
+  dark &= 0xFF;
+
+  outline(c, x - d, y - d, w, h, dark);
+  for (i = 1; i < d; ++i)
+    {
+      vspan(c, x - i, y - i, h, light);
+      hspan(c, x - i, y - i, w, light);
+    }
+  diagonal(c, x - d, y - d, d + 1, dark);
+  diagonal(c, x - d + w - 1, y - d, d + 1, dark);
+  diagonal(c, x - d, y - d + h - 1, d + 1, dark);
+
+  for (i = 1; i < h - 1; ++i)
+    hspan(c, x + 1, y + i, w - 2, WHITE & 0xFF);
+  outline(c, x, y, w, h, dark);
+}
+
+void pixels_fill(int x, int y, int w, int h, int color)
+{
+  icanvas *c = usable_canvas();
+  int i;
+
+  if (c == NULL)
+    {
+      FillArea(x, y, w, h, color);
+      return;
+    }
+
+  /* memset is already vectorized by the C library */
+  if (clip_rect(c, &x, &y, &w, &h))
+    for (i = 0; i < h; ++i)
+      memset(c->addr + (y + i) * c->scanline + x, color & 0xFF, w);
+}
+
+void pixels_invert(int x, int y, int w, int h)
+{
+  icanvas *c = usable_canvas();
+  int i;
+
+  if (c == NULL)
+    {
+      InvertArea(x, y, w, h);
+      return;
+    }
+
+  if (clip_rect(c, &x, &y, &w, &h))
+    for (i = 0; i < h; ++i)
+      invert_span(c->addr + (y + i) * c->scanline + x, w);
+}
+
+int pixels_stretch4(int x, int y, int w, int h,
+		    const unsigned char *src, int src_w, int src_h, int src_scanline)
+{
+  static unsigned char row[PIXELS_MAX_WIDTH + 1];
+  static unsigned short map[PIXELS_MAX_WIDTH];
+  icanvas *c = usable_canvas();
+  int cx = x, cy = y, cw = w, ch = h;
+  int i, j;
+  int prev_sy = -1;
+  unsigned char *prev = NULL;
+
+  if (c == NULL || src_w > PIXELS_MAX_WIDTH)
+    return 0;
+  if (w <= 0 || h <= 0 || !clip_rect(c, &cx, &cy, &cw, &ch))
+    return 1;
+  cw = min_int(cw, PIXELS_MAX_WIDTH);
+
+  /* source column of every visible target column, same rounding as StretchBitmap */
+  for (j = 0; j < cw; ++j)
+    map[j] = (cx - x + j) * src_w / w;
+
+  for (i = 0; i < ch; ++i)
+    {
+      const int sy = (cy - y + i) * src_h / h;
+      unsigned char *dst = c->addr + (cy + i) * c->scanline + cx;
+
+      /* rows repeated when scaling up are copied */
+      if (sy == prev_sy)
+	memcpy(dst, prev, cw);
+      else
+	{
+	  unpack4(row, src + sy * src_scanline, (src_w + 1) / 2);
+	  for (j = 0; j < cw; ++j)
+	    dst[j] = row[map[j]];
+	  prev_sy = sy;
+	}
+      prev = dst;
+    }
+  return 1;
+}
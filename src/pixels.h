@@ -0,0 +1,31 @@
+#ifndef PIXELS_H
+#define PIXELS_H
+
+/*
+  Pixel kernels drawing straight into the current canvas, clipped to its
+  clip rect.  They use SSE2 in x86 emulator builds, NEON on the device
+  and plain C elsewhere.  Canvases other than 8-bit are left to inkview.
+*/
+
+void pixels_fill(int x, int y, int w, int h, int color);
+void pixels_invert(int x, int y, int w, int h);
+
+/* outline thickness pixels wide inside the rect */
+void pixels_frame(int x, int y, int w, int h, int thickness, int color);
+
+/*
+  Tile of w by h at x, y raised by depth pixels: the outline of its
+  back, the bevel on the left and top with its corner edges, and the
+  white face with an outline.
+*/
+void pixels_tile(int x, int y, int w, int h, int depth, int light, int dark);
+
+/*
+  Nearest neighbour scaling of a 4-bit image (two pixels per byte, left
+  one in the high nibble) to w by h; returns 0 if the canvas is not
+  8-bit and nothing was drawn.
+*/
+int pixels_stretch4(int x, int y, int w, int h,
+		    const unsigned char *src, int src_w, int src_h, int src_scanline);
+
+#endif
@@ -0,0 +1,139 @@
+#include <limits.h>
+#include "rating.h"
+#include "common.h"
+#include "trace.h"
+
+#define RATING_PLAYOUTS (16)
+#define RATING_CANDIDATES (12)
+
+/* score bands of the difficulty tiers */
+#define EASY_MAX_SCORE (25)
+#define HARD_MIN_SCORE (40)
+
+/* plays random fitting pairs until the board is cleared or stuck */
+static void playout(board_t *board, int *moves, int *pairs_sum, int *forced)
+{
+  static positions_t selectable;
+  static move_t stack[72];
+  int count = 0;
+
+  while (count < 72)
+    {
+      int i, j;
+      int pairs = 0;
+      int chosen;
+      int p1 = -1;
+      int p2 = -1;
+
+      board_get_selectables(board, &selectable);
+      for (i = 0; i < selectable.count - 1; ++i)
+	{
+	  const chip_t chip1 = board_get(board, selectable.positions[i]);
+	  for (j = i + 1; j < selectable.count; ++j)
+	    if (chips_fit(chip1, board_get(board, selectable.positions[j])))
+	      ++pairs;
+	}
+
+      if (pairs == 0)
+	break;
+
+      *pairs_sum += pairs;
+      if (pairs == 1)
+	++*forced;
+
+      chosen = rrand(pairs);
+      for (i = 0; i < selectable.count - 1 && p1 < 0; ++i)
+	{
+	  const chip_t chip1 = board_get(board, selectable.positions[i]);
+	  for (j = i + 1; j < selectable.count; ++j)
+	    if (chips_fit(chip1, board_get(board, selectable.positions[j])) && chosen-- == 0)
+	      {
+		p1 = i;
+		p2 = j;
+		break;
+	      }
+	}
+
+      board_remove_pair(board, selectable.positions[p1], selectable.positions[p2], &stack[count]);
+      ++count;
+    }
+
+  *moves += count;
+
+  while (count > 0)
+    board_restore_pair(board, &stack[--count]);
+}
+
+void rate_board(board_t *board, rating_t *rating)
+{
+  int i;
+  int moves = 0;
+  int pairs_sum = 0;
+  int forced = 0;
+  int traps = 0;
+
+  for (i = 0; i < RATING_PLAYOUTS; ++i)
+    {
+      const int before = moves;
+      playout(board, &moves, &pairs_sum, &forced);
+      if (2 * (moves - before) < board->chip_count)
+	++traps;
+    }
+
+  rating->branching = moves ? 10 * pairs_sum / moves : 0;
+  rating->traps = 100 * traps / RATING_PLAYOUTS;
+  rating->forced = moves ? 100 * forced / moves : 0;
+
+  /* dead ends dominate, scarce choice and forced moves add to it */
+  rating->score = (3 * rating->traps
+		   + 2 * max_int(0, 100 - 2 * rating->branching)
+		   + rating->forced) / 6;
+}
+
+static int band_distance(int score, difficulty_t difficulty)
+{
+  switch (difficulty)
+    {
+    case DIFFICULTY_EASY:
+      return max_int(0, score - EASY_MAX_SCORE);
+    case DIFFICULTY_MEDIUM:
+      return max_int(0, max_int(EASY_MAX_SCORE - score, score - HARD_MIN_SCORE));
+    case DIFFICULTY_HARD:
+      return max_int(0, HARD_MIN_SCORE - score);
+    default:
+      return 0;
+    }
+}
+
+void generate_rated_board(board_t *board, map_t *map, difficulty_t difficulty)
+{
+  TRACE_SCOPE("generate_rated_board");
+  int i;
+  int best_distance = INT_MAX;
+  board_t candidate;
+
+  generate_board(board, map);
+  if (difficulty == DIFFICULTY_ANY)
+    return;
+
+  for (i = 0; i < RATING_CANDIDATES; ++i)
+    {
+      rating_t rating;
+      int distance;
+
+      if (i > 0)
+	generate_board(&candidate, map);
+      else
+	candidate = *board;
+
+      rate_board(&candidate, &rating);
+      distance = band_distance(rating.score, difficulty);
+      if (distance < best_distance)
+	{
+	  *board = candidate;
+	  best_distance = distance;
+	}
+      if (distance == 0)
+	break;
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef RATING_H
+#define RATING_H
+
+#include "board.h"
+
+typedef enum {
+  DIFFICULTY_ANY,
+  DIFFICULTY_EASY,
+  DIFFICULTY_MEDIUM,
+  DIFFICULTY_HARD
+} difficulty_t;
+
+typedef struct {
+  int branching; /* average number of available pairs per move, in tenths */
+  int traps;     /* percent of random playouts ending in a dead end */
+  int forced;    /* percent of moves with a single available pair */
+  int score;     /* 0 (trivial) .. 100 (brutal) */
+} rating_t;
+
+void rate_board(board_t *board, rating_t *rating);
+
+void generate_rated_board(board_t *board, map_t *map, difficulty_t difficulty);
+
+#endif
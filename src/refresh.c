@@ -0,0 +1,141 @@
+#include <string.h>
+#include <limits.h>
+#include "inkview.h"
+
+#include "common.h"
+#include "geometry.h"
+#include "refresh.h"
+#include "trace.h"
+
+#define REFRESH_GRID_COLS (8)
+#define REFRESH_GRID_ROWS (8)
+
+#define REFRESH_QUEUE_SIZE (16)
+
+/* fixed cost of a panel update, in pixels of updated area */
+#define REFRESH_UPDATE_COST (20000)
+
+static int g_budget = REFRESH_DEFAULT_BUDGET;
+static unsigned char g_ghosting[REFRESH_GRID_ROWS][REFRESH_GRID_COLS];
+
+static struct rect g_queue[REFRESH_QUEUE_SIZE];
+static int g_queue_count = 0;
+static int g_full_requested = 0;
+
+void refresh_set_budget(int budget)
+{
+  g_budget = min_int(max_int(budget, 1), 254);
+}
+
+void refresh_full(void)
+{
+  g_full_requested = 1;
+}
+
+static int area(const struct rect *r)
+{
+  return r->w * r->h;
+}
+
+/* extra area a merged update would cover, less the update it saves */
+static int merge_cost(const struct rect *r1, const struct rect *r2)
+{
+  struct rect r;
+  union_rect(r1, r2, &r);
+  return area(&r) - area(r1) - area(r2) - REFRESH_UPDATE_COST;
+}
+
+static void merge(int i, int j)
+{
+  struct rect r;
+  union_rect(&g_queue[i], &g_queue[j], &r);
+  g_queue[i] = r;
+  g_queue[j] = g_queue[--g_queue_count];
+}
+
+/* merges the cheapest pair of queued rects if that pays off or is forced */
+static int merge_cheapest(int force)
+{
+  int i, j;
+  int best_i = -1;
+  int best_j = -1;
+  int best_cost = INT_MAX;
+
+  for (i = 0; i < g_queue_count - 1; ++i)
+    for (j = i + 1; j < g_queue_count; ++j)
+      {
+	const int cost = merge_cost(&g_queue[i], &g_queue[j]);
+	if (cost < best_cost)
+	  {
+	    best_i = i;
+	    best_j = j;
+	    best_cost = cost;
+	  }
+      }
+
+  if (best_i < 0 || (best_cost > 0 && !force))
+    return 0;
+  merge(best_i, best_j);
+  return 1;
+}
+
+void refresh_partial(int x, int y, int w, int h)
+{
+  struct rect *r;
+  const int x2 = min_int(x + w, ScreenWidth());
+  const int y2 = min_int(y + h, ScreenHeight());
+
+  x = max_int(x, 0);
+  y = max_int(y, 0);
+  if (x2 <= x || y2 <= y)
+    return;
+
+  if (g_queue_count == REFRESH_QUEUE_SIZE)
+    merge_cheapest(1);
+
+  r = &g_queue[g_queue_count++];
+  r->x = x;
+  r->y = y;
+  r->w = x2 - x;
+  r->h = y2 - y;
+}
+
+/* accounts ghosting of a partial update, returns 0 if the budget is exceeded */
+static int account(const struct rect *r)
+{
+  int i, j;
+  int ok = 1;
+  const int cell_w = (ScreenWidth() + REFRESH_GRID_COLS - 1) / REFRESH_GRID_COLS;
+  const int cell_h = (ScreenHeight() + REFRESH_GRID_ROWS - 1) / REFRESH_GRID_ROWS;
+
+  for (i = r->y / cell_h; i <= (r->y + r->h - 1) / cell_h; ++i)
+    for (j = r->x / cell_w; j <= (r->x + r->w - 1) / cell_w; ++j)
+      if (++g_ghosting[i][j] > g_budget)
+	ok = 0;
+  return ok;
+}
+
+void refresh_flush(void)
+{
+  TRACE_SCOPE("refresh_flush");
+  int i;
+
+  while (merge_cheapest(0))
+    ;
+
+  for (i = 0; i < g_queue_count && !g_full_requested; ++i)
+    if (!account(&g_queue[i]))
+      g_full_requested = 1;
+
+  if (g_full_requested)
+    {
+      memset(g_ghosting, 0, sizeof(g_ghosting));
+      FullUpdate();
+    }
+  else
+    for (i = 0; i < g_queue_count; ++i)
+      PartialUpdate(g_queue[i].x, g_queue[i].y, g_queue[i].w, g_queue[i].h);
+
+  g_queue_count = 0;
+  g_full_requested = 0;
+}
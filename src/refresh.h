@@ -0,0 +1,22 @@
+#ifndef REFRESH_H
+#define REFRESH_H
+
+/*
+  E-ink refresh policy.  Changes are queued while an event is handled
+  and flushed once at its end: nearby rects are merged when one update
+  is cheaper than two, and the rest get fast partial updates.  The
+  number of updates over each screen region is tracked as an estimate
+  of ghosting; once a region exceeds the budget the flush is escalated
+  to a full refresh.
+*/
+
+#define REFRESH_DEFAULT_BUDGET (16)
+
+void refresh_set_budget(int budget);
+
+void refresh_partial(int x, int y, int w, int h);
+void refresh_full(void);
+
+void refresh_flush(void);
+
+#endif
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "common.h"
+#include "startup.h"
+
+static struct {
+  const char *phase;
+  int64_t us;
+} g_marks[STARTUP_MAX_MARKS];
+static int g_mark_count = 0;
+static int g_shown = 0;
+static const char *g_log_path = NULL;
+
+void startup_mark(const char *phase)
+{
+  if (g_mark_count == STARTUP_MAX_MARKS)
+    return;
+  g_marks[g_mark_count].phase = phase;
+  g_marks[g_mark_count].us = clock_us();
+  ++g_mark_count;
+}
+
+void startup_set_log(const char *path)
+{
+  g_log_path = path;
+}
+
+static void write_log(const char *path)
+{
+  int i;
+  FILE *f = fopen(path, "w");
+
+  if (!f)
+    return;
+  fprintf(f, "%-16s %10s %10s\n", "phase", "us", "total us");
+  for (i = 1; i < g_mark_count; ++i)
+    fprintf(f, "%-16s %10" PRId64 " %10" PRId64 "\n", g_marks[i].phase,
+	    g_marks[i].us - g_marks[i - 1].us,
+	    g_marks[i].us - g_marks[0].us);
+  fclose(f);
+}
+
+void startup_shown(void)
+{
+  if (g_shown)
+    return;
+  g_shown = 1;
+
+  startup_mark("first frame");
+  if (g_log_path != NULL)
+    write_log(g_log_path);
+}
@@ -0,0 +1,21 @@
+#ifndef STARTUP_H
+#define STARTUP_H
+
+/*
+  Timeline of the start of the application: each mark records the time
+  a phase of EVT_INIT ended, and the timeline closes once the first
+  EVT_SHOW has painted.  The marks are cheap and always taken; the log
+  is only written when asked for.
+*/
+
+#define STARTUP_MAX_MARKS (16)
+
+void startup_mark(const char *phase);
+
+/* where the timeline goes when it closes, NULL for nowhere */
+void startup_set_log(const char *path);
+
+/* end of an EVT_SHOW; the first one marks the first frame and writes the log */
+void startup_shown(void);
+
+#endif
@@ -0,0 +1,62 @@
+#ifdef PB_TRACE
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "common.h"
+#include "trace.h"
+
+typedef struct {
+  const char *name;
+  int64_t us;
+  char phase;
+} trace_event_t;
+
+static trace_event_t g_ring[TRACE_RING_SIZE];
+static unsigned int g_next = 0; /* total events recorded, wraps the ring */
+
+static void record(const char *name, char phase)
+{
+  trace_event_t *event = &g_ring[g_next % TRACE_RING_SIZE];
+  event->name = name;
+  event->us = clock_us();
+  event->phase = phase;
+  ++g_next;
+}
+
+void trace_begin(const char *name)
+{
+  record(name, 'B');
+}
+
+void trace_end(const char *name)
+{
+  record(name, 'E');
+}
+
+void trace_scope_end(const char **name)
+{
+  record(*name, 'E');
+}
+
+void trace_dump(const char *path)
+{
+  const unsigned int count = g_next < TRACE_RING_SIZE ? g_next : TRACE_RING_SIZE;
+  unsigned int i;
+  FILE *f = fopen(path, "w");
+
+  if (!f)
+    return;
+
+  fprintf(f, "{\"traceEvents\":[\n");
+  for (i = 0; i < count; ++i)
+    {
+      const trace_event_t *event = &g_ring[(g_next - count + i) % TRACE_RING_SIZE];
+      fprintf(f, "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%" PRId64 ",\"pid\":1,\"tid\":1}%s\n",
+	      event->name, event->phase, event->us, i + 1 < count ? "," : "");
+    }
+  fprintf(f, "],\"displayTimeUnit\":\"ms\"}\n");
+  fclose(f);
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+  Begin and end markers of hot paths, kept in a fixed ring of the latest
+  TRACE_RING_SIZE events and dumped as a Chrome trace (chrome://tracing,
+  Perfetto).  Built only with PB_TRACE defined ('make TRACE=1'); without
+  it the markers expand to nothing.
+
+  TRACE_SCOPE(name) marks the rest of the enclosing block.  Names must be
+  string literals, only the pointer is kept.
+*/
+
+#ifdef PB_TRACE
+
+#define TRACE_RING_SIZE (4096)
+
+void trace_begin(const char *name);
+void trace_end(const char *name);
+void trace_scope_end(const char **name);
+
+/* writes the ring as JSON, oldest event first */
+void trace_dump(const char *path);
+
+#define TRACE_BEGIN(name) trace_begin(name)
+#define TRACE_END(name) trace_end(name)
+#define TRACE_SCOPE(name) \
+  const char *trace_scope_ __attribute__((cleanup(trace_scope_end), unused)) = (trace_begin(name), (name))
+#define TRACE_DUMP(path) trace_dump(path)
+
+#else
+
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name) ((void)0)
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_DUMP(path) ((void)0)
+
+#endif
+
+#endif
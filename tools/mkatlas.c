@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+  Packs the tile faces into the atlas of src/atlas.h:
+
+    mkatlas [-w WIDTH,...] OUT.c chip_51.bmp chip_52.bmp ...
+
+  Every file must be an uncompressed 8-bit palette or 24-bit BMP of the
+  same size, named after the chip it shows in hex.  Besides the original
+  size, a level is made for every width given with -w by averaging the
+  source pixels each target pixel covers.  Pixels are reduced to 4-bit
+  gray, two to a byte with the left one in the high nibble, and the tiles
+  of a level are stored one under the other.
+*/
+
+#define MAX_TILES 255
+#define MAX_LEVELS 4
+
+typedef struct {
+  unsigned int width;
+  unsigned int height;
+  unsigned char *gray; /* 8-bit, top-down */
+} image_t;
+
+static unsigned int le16(const unsigned char *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+static unsigned int le32(const unsigned char *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static int luma(int r, int g, int b)
+{
+  return (r * 299 + g * 587 + b * 114) / 1000;
+}
+
+static unsigned char *read_file(const char *path, long *size)
+{
+  unsigned char *buf;
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return NULL;
+
+  fseek(f, 0, SEEK_END);
+  *size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  buf = malloc(*size);
+  if (fread(buf, 1, *size, f) != (size_t)*size)
+    {
+      free(buf);
+      buf = NULL;
+    }
+  fclose(f);
+  return buf;
+}
+
+static int load_bmp(const char *path, image_t *image)
+{
+  long size;
+  unsigned char *bmp = read_file(path, &size);
+  unsigned int offset, bpp, stride, x, y;
+  int height;
+
+  if (bmp == NULL || size < 54 || bmp[0] != 'B' || bmp[1] != 'M')
+    {
+      fprintf(stderr, "mkatlas: %s: not a BMP file\n", path);
+      free(bmp);
+      return 0;
+    }
+
+  offset = le32(bmp + 10);
+  height = (int)le32(bmp + 22);
+  bpp = le16(bmp + 28);
+  if ((bpp != 8 && bpp != 24) || le32(bmp + 30) != 0)
+    {
+      fprintf(stderr, "mkatlas: %s: unsupported format\n", path);
+      free(bmp);
+      return 0;
+    }
+
+  image->width = le32(bmp + 18);
+  image->height = height < 0 ? -height : height;
+  image->gray = malloc(image->width * image->height);
+  stride = (image->width * bpp / 8 + 3) & ~3u;
+
+  for (y = 0; y < image->height; ++y)
+    {
+      /* rows are stored bottom-up unless the height is negative */
+      const unsigned char *row = bmp + offset + stride * (height < 0 ? y : image->height - 1 - y);
+      for (x = 0; x < image->width; ++x)
+	{
+	  int v;
+	  if (bpp == 8)
+	    {
+	      const unsigned char *pal = bmp + 14 + le32(bmp + 14) + 4 * row[x];
+	      v = luma(pal[2], pal[1], pal[0]);
+	    }
+	  else
+	    v = luma(row[3 * x + 2], row[3 * x + 1], row[3 * x]);
+	  image->gray[y * image->width + x] = v;
+	}
+    }
+
+  free(bmp);
+  return 1;
+}
+
+/* chip_XX.bmp shows chip 0xXX */
+static int chip_code(const char *path)
+{
+  const char *base = strrchr(path, '/');
+  unsigned int chip;
+
+  base = base ? base + 1 : path;
+  if (sscanf(base, "chip_%2x.bmp", &chip) != 1 || chip == 0 || chip > 0xFF)
+    return -1;
+  return chip;
+}
+
+static int quantize(int v)
+{
+  return (v * 15 + 127) / 255;
+}
+
+/* overlap of the source pixel [i, i + 1) with the span [a, b) */
+static double coverage(int i, double a, double b)
+{
+  const double lo = i > a ? i : a;
+  const double hi = i + 1 < b ? i + 1 : b;
+  return hi > lo ? hi - lo : 0;
+}
+
+static void downscale(const image_t *src, image_t *dst, unsigned int width, unsigned int height)
+{
+  const double fx = (double)src->width / width;
+  const double fy = (double)src->height / height;
+  unsigned int x, y;
+  int i, j;
+
+  dst->width = width;
+  dst->height = height;
+  dst->gray = malloc(width * height);
+
+  for (y = 0; y < height; ++y)
+    for (x = 0; x < width; ++x)
+      {
+	const double x0 = x * fx, x1 = (x + 1) * fx;
+	const double y0 = y * fy, y1 = (y + 1) * fy;
+	double sum = 0, area = 0;
+
+	for (i = (int)y0; i < y1 && i < (int)src->height; ++i)
+	  for (j = (int)x0; j < x1 && j < (int)src->width; ++j)
+	    {
+	      const double w = coverage(i, y0, y1) * coverage(j, x0, x1);
+	      sum += w * src->gray[i * src->width + j];
+	      area += w;
+	    }
+	dst->gray[y * width + x] = (unsigned char)(sum / area + 0.5);
+      }
+}
+
+static void write_level(FILE *out, int level, image_t *tiles, int count)
+{
+  const unsigned int scanline = (tiles[0].width + 1) / 2;
+  unsigned int x, y;
+  int i, n = 0;
+
+  fprintf(out, "static const unsigned char level%d_data[] = {", level);
+  for (i = 0; i < count; ++i)
+    for (y = 0; y < tiles[i].height; ++y)
+      for (x = 0; x < scanline; ++x)
+	{
+	  const unsigned char *row = tiles[i].gray + y * tiles[i].width;
+	  const int hi = quantize(row[2 * x]);
+	  const int lo = 2 * x + 1 < tiles[i].width ? quantize(row[2 * x + 1]) : 0;
+	  fprintf(out, "%s0x%02x,", n++ % 16 ? " " : "\n  ", (hi << 4) | lo);
+	}
+  fprintf(out, "\n};\n\n");
+}
+
+int main(int argc, char **argv)
+{
+  unsigned char index[256];
+  static image_t tiles[MAX_LEVELS][MAX_TILES];
+  unsigned int widths[MAX_LEVELS];
+  int level_count = 1;
+  int count, i, l;
+  FILE *out;
+
+  if (argc > 2 && !strcmp(argv[1], "-w"))
+    {
+      const char *p = argv[2];
+      int n;
+
+      while (level_count < MAX_LEVELS && sscanf(p, "%u%n", &widths[level_count], &n) == 1)
+	{
+	  ++level_count;
+	  p += n;
+	  if (*p != ',')
+	    break;
+	  ++p;
+	}
+      argc -= 2;
+      argv += 2;
+    }
+
+  count = argc - 2;
+  if (argc < 3 || count > MAX_TILES)
+    {
+      fprintf(stderr, "usage: mkatlas [-w WIDTH,...] OUT.c chip_XX.bmp...\n");
+      return 1;
+    }
+
+  memset(index, 0, sizeof(index));
+  for (i = 0; i < count; ++i)
+    {
+      const char *path = argv[i + 2];
+      const int chip = chip_code(path);
+
+      if (chip < 0)
+	{
+	  fprintf(stderr, "mkatlas: %s: not named chip_XX.bmp\n", path);
+	  return 1;
+	}
+      if (!load_bmp(path, &tiles[0][i]))
+	return 1;
+      if (tiles[0][i].width != tiles[0][0].width || tiles[0][i].height != tiles[0][0].height)
+	{
+	  fprintf(stderr, "mkatlas: %s: size differs from %s\n", path, argv[2]);
+	  return 1;
+	}
+      index[chip] = i + 1;
+    }
+
+  out = fopen(argv[1], "w");
+  if (!out)
+    {
+      perror(argv[1]);
+      return 1;
+    }
+
+  for (l = 1; l < level_count; ++l)
+    {
+      const unsigned int width = widths[l];
+      const unsigned int height = (width * tiles[0][0].height + tiles[0][0].width / 2) / tiles[0][0].width;
+
+      if (width == 0 || width >= tiles[0][0].width)
+	{
+	  fprintf(stderr, "mkatlas: level width %u is not below %u\n", width, tiles[0][0].width);
+	  return 1;
+	}
+      for (i = 0; i < count; ++i)
+	downscale(&tiles[0][i], &tiles[l][i], width, height);
+    }
+
+  fprintf(out, "#include \"src/atlas.h\"\n\n");
+  for (l = 0; l < level_count; ++l)
+    write_level(out, l, tiles[l], count);
+
+  fprintf(out, "const atlas_t tile_atlas = {\n  %d, %d,\n  {", count, level_count);
+  for (i = 0; i < 256; ++i)
+    fprintf(out, "%s%d,", i % 16 ? " " : "\n    ", index[i]);
+  fprintf(out, "\n  },\n  {\n");
+  for (l = 0; l < level_count; ++l)
+    fprintf(out, "    { %u, %u, %u, level%d_data },\n", tiles[l][0].width, tiles[l][0].height, (tiles[l][0].width + 1) / 2, l);
+  fprintf(out, "  }\n};\n");
+
+  fclose(out);
+  return 0;
+}